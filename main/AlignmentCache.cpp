@@ -0,0 +1,354 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Lineup
+    Comparative visualisation and alignment of related audio recordings
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "AlignmentCache.h"
+
+#include "data/model/AlignmentModel.h"
+#include "transform/TransformFactory.h"
+#include "base/TempDirectory.h"
+#include "base/TempWriteFile.h"
+#include "base/Exceptions.h"
+#include "base/Debug.h"
+
+#include <QDir>
+#include <QFile>
+#include <QDateTime>
+#include <QDataStream>
+#include <QCryptographicHash>
+#include <QSettings>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThreadPool>
+
+#include <vector>
+#include <cstring>
+
+static const char *const alignmentMagic = "VECTALN1";
+static const quint32 alignmentVersion = 2;
+
+AlignmentCache *
+AlignmentCache::getInstance()
+{
+    static AlignmentCache instance;
+    return &instance;
+}
+
+AlignmentCache::AlignmentCache()
+{
+}
+
+bool
+AlignmentCache::isCacheable(Align::AlignmentType type)
+{
+    // External programs are outside our control and may change
+    // without notice, and there is nothing to gain from caching the
+    // trivial methods
+    switch (type) {
+    case Align::MATCHAlignment:
+    case Align::MATCHAlignmentWithPitchCompare:
+    case Align::SungNoteContourAlignment:
+        return true;
+    default:
+        return false;
+    }
+}
+
+QString
+AlignmentCache::getCacheDirectory()
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (m_directory != "") {
+        return m_directory;
+    }
+
+    QDir parentDir(TempDirectory::getInstance()->getContainingPath());
+    QString cacheDirName("cache/alignment");
+
+    if (!parentDir.mkpath(cacheDirName)) {
+        SVCERR << "ERROR: AlignmentCache: Failed to create cache dir in \""
+               << parentDir.canonicalPath() << "\"" << endl;
+        return {};
+    }
+
+    m_directory = parentDir.filePath(cacheDirName);
+    return m_directory;
+}
+
+int
+AlignmentCache::getSizeLimitMB()
+{
+    QSettings settings;
+    settings.beginGroup("Preferences");
+    int limit = settings.value("alignment-cache-limit-mb", 256).toInt();
+    settings.endGroup();
+    return limit;
+}
+
+QString
+AlignmentCache::getEntryPath(QString key)
+{
+    QString dir = getCacheDirectory();
+    if (dir == "" || key == "") return {};
+
+    QString name = QCryptographicHash::hash
+        (key.toUtf8(), QCryptographicHash::Sha1).toHex();
+    return QDir(dir).filePath(name + ".path");
+}
+
+QString
+AlignmentCache::getPluginVersions(Align::AlignmentType type)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_pluginVersions.find(type) != m_pluginVersions.end()) {
+            return m_pluginVersions[type];
+        }
+    }
+
+    std::vector<TransformId> ids;
+
+    switch (type) {
+    case Align::MATCHAlignment:
+        ids.push_back("vamp:match-vamp-plugin:match:path");
+        ids.push_back("vamp:match-vamp-plugin:match-subsequence:path");
+        break;
+    case Align::MATCHAlignmentWithPitchCompare:
+        ids.push_back("vamp:match-vamp-plugin:match:path");
+        ids.push_back("vamp:match-vamp-plugin:match-subsequence:path");
+        ids.push_back("vamp:tuning-difference:tuning-difference:tuningfreq");
+        break;
+    case Align::SungNoteContourAlignment:
+        ids.push_back("vamp:pyin:pyin:notes");
+        break;
+    default:
+        break;
+    }
+
+    TransformFactory *tf = TransformFactory::getInstance();
+
+    QStringList versions;
+    for (auto id: ids) {
+        if (tf->haveTransform(id)) {
+            Transform t = tf->getDefaultTransformFor(id);
+            versions.push_back(QString("%1=%2").arg(id)
+                               .arg(t.getPluginVersion()));
+        } else {
+            versions.push_back(QString("%1=none").arg(id));
+        }
+    }
+
+    QString result = versions.join(";");
+
+    QMutexLocker locker(&m_mutex);
+    m_pluginVersions[type] = result;
+    return result;
+}
+
+QString
+AlignmentCache::makeKey(QString referenceHash, QString alignedHash,
+                        Align::AlignmentType type, bool subsequence)
+{
+    if (referenceHash == "" || alignedHash == "" || !isCacheable(type)) {
+        return {};
+    }
+
+    return QString("%1|%2|%3|%4|%5")
+        .arg(referenceHash)
+        .arg(alignedHash)
+        .arg(Align::getAlignmentTypeTag(type))
+        .arg(subsequence ? "subsequence" : "full")
+        .arg(getPluginVersions(type));
+}
+
+class AlignmentCache::StoreTask : public QRunnable
+{
+public:
+    StoreTask(AlignmentCache *cache, QString key, double sampleRate,
+              const Path &path) :
+        m_cache(cache), m_key(key), m_sampleRate(sampleRate),
+        m_path(path) { }
+
+    void run() override {
+        m_cache->write(m_key, m_sampleRate, m_path);
+    }
+
+private:
+    AlignmentCache *m_cache;
+    QString m_key;
+    double m_sampleRate;
+    Path m_path;
+};
+
+void
+AlignmentCache::store(QString key, ModelId alignedModel)
+{
+    if (key == "") return;
+
+    auto model = ModelById::get(alignedModel);
+    if (!model) return;
+
+    // The path as the aligner produced it, at its own feature rate,
+    // is all we need to reproduce the mapping
+    auto alignment = ModelById::getAs<AlignmentModel>(model->getAlignment());
+    const Path *path = (alignment ? alignment->getPath() : nullptr);
+    if (!path || path->getPoints().empty()) {
+        SVDEBUG << "AlignmentCache::store: No alignment path for "
+                << alignedModel << ", not caching" << endl;
+        return;
+    }
+
+    QThreadPool::globalInstance()->start
+        (new StoreTask(this, key, double(model->getSampleRate()), *path));
+}
+
+void
+AlignmentCache::write(QString key, double sampleRate, const Path &path)
+{
+    QString entryPath = getEntryPath(key);
+    if (entryPath == "") return;
+
+    const auto &points = path.getPoints();
+
+    try {
+        TempWriteFile tempFile(entryPath);
+
+        QFile f(tempFile.getTemporaryFilename());
+        if (!f.open(QIODevice::WriteOnly)) {
+            SVCERR << "AlignmentCache::store: Failed to open temporary file for "
+                   << entryPath << endl;
+            return;
+        }
+
+        QDataStream out(&f);
+        out.writeRawData(alignmentMagic, int(strlen(alignmentMagic)));
+        out << alignmentVersion << key << sampleRate
+            << qint32(path.getResolution()) << quint32(points.size());
+        for (const auto &p: points) {
+            out << qint64(p.frame) << qint64(p.mapframe);
+        }
+
+        f.close();
+        tempFile.moveToTarget();
+
+    } catch (const FileOperationFailed &) {
+        SVCERR << "AlignmentCache::store: Failed to write cache entry "
+               << entryPath << endl;
+        return;
+    }
+
+    SVDEBUG << "AlignmentCache: stored " << points.size()
+            << " path points in " << entryPath << endl;
+
+    prune();
+}
+
+void
+AlignmentCache::prune()
+{
+    QString dir = getCacheDirectory();
+    if (dir == "") return;
+
+    QMutexLocker locker(&m_mutex);
+
+    qint64 limit = qint64(getSizeLimitMB()) * 1024 * 1024;
+
+    QFileInfoList entries = QDir(dir).entryInfoList
+        (QStringList() << "*.path", QDir::Files, QDir::Time | QDir::Reversed);
+
+    qint64 total = 0;
+    for (const auto &e: entries) {
+        total += e.size();
+    }
+
+    // Least recently used first, as restore() touches each entry it
+    // uses
+    for (const auto &e: entries) {
+        if (total <= limit) break;
+        SVDEBUG << "AlignmentCache: pruning " << e.filePath() << endl;
+        total -= e.size();
+        QFile::remove(e.filePath());
+    }
+}
+
+bool
+AlignmentCache::restore(QString key, ModelId referenceModel,
+                        ModelId alignedModel)
+{
+    QString entryPath = getEntryPath(key);
+    if (entryPath == "") return false;
+
+    QFile f(entryPath);
+    if (!f.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    auto model = ModelById::get(alignedModel);
+    if (!model) return false;
+
+    QDataStream in(&f);
+
+    QByteArray magic(int(strlen(alignmentMagic)), '\0');
+    in.readRawData(magic.data(), magic.size());
+
+    quint32 version = 0;
+    QString storedKey;
+    double sampleRate = 0;
+    qint32 resolution = 0;
+    quint32 count = 0;
+    in >> version >> storedKey >> sampleRate >> resolution >> count;
+
+    if (magic != alignmentMagic ||
+        version != alignmentVersion ||
+        storedKey != key ||
+        sampleRate != model->getSampleRate() ||
+        resolution <= 0 ||
+        in.status() != QDataStream::Ok) {
+        SVDEBUG << "AlignmentCache: stale or mismatched entry "
+                << entryPath << endl;
+        return false;
+    }
+
+    Path path(sampleRate, resolution);
+
+    for (quint32 i = 0; i < count; ++i) {
+        qint64 frame = 0, mapframe = 0;
+        in >> frame >> mapframe;
+        if (in.status() != QDataStream::Ok) {
+            SVDEBUG << "AlignmentCache: truncated entry "
+                    << entryPath << endl;
+            return false;
+        }
+        path.add(PathPoint(frame, mapframe));
+    }
+
+    auto alignment = std::make_shared<AlignmentModel>
+        (referenceModel, alignedModel, ModelId());
+    alignment->setPath(path);
+
+    ModelId previous = model->getAlignment();
+    model->setAlignment(ModelById::add(alignment));
+    if (!previous.isNone()) {
+        ModelById::release(previous);
+    }
+
+    // Mark the entry as recently used, for prune()
+    f.setFileTime(QDateTime::currentDateTime(),
+                  QFileDevice::FileModificationTime);
+
+    SVDEBUG << "AlignmentCache: restored alignment of " << alignedModel
+            << " from " << entryPath << endl;
+
+    return true;
+}
@@ -0,0 +1,96 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Lineup
+    Comparative visualisation and alignment of related audio recordings
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef VECT_ALIGNMENT_CACHE_H
+#define VECT_ALIGNMENT_CACHE_H
+
+#include <QString>
+#include <QMutex>
+
+#include "data/model/Model.h"
+#include "data/model/Path.h"
+#include "align/Align.h"
+
+#include <map>
+
+/**
+ * Persistent cache of finished alignment paths, stored in a "cache"
+ * directory alongside the temporary directory.
+ *
+ * An entry is keyed by the content hashes of the reference and
+ * aligned audio (see AudioCache::getContentHash), the alignment type
+ * and subsequence flag, and the versions of the plugins that the
+ * alignment type uses. Restoring an entry attaches a complete
+ * AlignmentModel to the aligned model, so that Document will not
+ * re-run the aligner for it. The least recently used entries are
+ * removed once the cache exceeds getSizeLimitMB().
+ */
+class AlignmentCache
+{
+public:
+    static AlignmentCache *getInstance();
+
+    /**
+     * Return true if alignments of the given type are worth caching
+     * and can be expected to be reproducible.
+     */
+    static bool isCacheable(Align::AlignmentType type);
+
+    /**
+     * Return the cache key for aligning the model with content hash
+     * alignedHash against the reference with content hash
+     * referenceHash using the given method, or an empty string if
+     * either hash is empty or the type is not cacheable.
+     */
+    QString makeKey(QString referenceHash, QString alignedHash,
+                    Align::AlignmentType type, bool subsequence);
+
+    /**
+     * Record the current alignment of the given model under the
+     * given key. The model's alignment should be complete. The path
+     * is copied immediately but written on a background thread.
+     */
+    void store(QString key, ModelId alignedModel);
+
+    /**
+     * If an alignment is cached under the given key, attach it to
+     * alignedModel as a complete alignment against referenceModel
+     * and return true. Otherwise return false. Any alignment that
+     * alignedModel already had is released.
+     */
+    bool restore(QString key, ModelId referenceModel, ModelId alignedModel);
+
+    /**
+     * Return the maximum size of the cache in megabytes, from the
+     * "alignment-cache-limit-mb" preference.
+     */
+    static int getSizeLimitMB();
+
+private:
+    AlignmentCache();
+
+    class StoreTask;
+    void write(QString key, double sampleRate, const Path &path);
+
+    QString getCacheDirectory();
+    QString getEntryPath(QString key);
+    QString getPluginVersions(Align::AlignmentType type);
+    void prune();
+
+    QMutex m_mutex;
+    QString m_directory;
+    std::map<Align::AlignmentType, QString> m_pluginVersions;
+};
+
+#endif
@@ -0,0 +1,127 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Lineup
+    Comparative visualisation and alignment of related audio recordings
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "AlignmentMapping.h"
+
+#include "data/model/AlignmentModel.h"
+#include "data/model/Path.h"
+#include "base/BaseTypes.h"
+#include "base/Debug.h"
+
+#include <algorithm>
+#include <cmath>
+
+std::vector<sv_frame_t>
+AlignmentMapping::fromReference(ModelId alignedModel,
+                                const std::vector<sv_frame_t> &referenceFrames)
+{
+    std::vector<sv_frame_t> mapped;
+    mapped.reserve(referenceFrames.size());
+
+    auto model = ModelById::get(alignedModel);
+    auto alignment = model ?
+        ModelById::getAs<AlignmentModel>(model->getAlignment()) : nullptr;
+
+    if (!alignment) {
+        mapped = referenceFrames;
+        return mapped;
+    }
+
+    sv_frame_t end = model->getEndFrame();
+
+    const Path *path = alignment->getPath();
+    if (!path || path->getPoints().empty()) {
+        // Nothing to merge against; let the alignment model decide
+        for (sv_frame_t frame: referenceFrames) {
+            sv_frame_t out = alignment->fromReference(frame);
+            if (out > end) out = end;
+            mapped.push_back(out);
+        }
+        return mapped;
+    }
+
+    // The path maps aligned frames to reference frames; we want the
+    // reverse, ordered by reference frame
+    
+    std::vector<std::pair<sv_frame_t, sv_frame_t>> reverse;
+    for (const auto &p: path->getPoints()) {
+        reverse.push_back({ p.mapframe, p.frame });
+    }
+    std::stable_sort(reverse.begin(), reverse.end(),
+                     [](const std::pair<sv_frame_t, sv_frame_t> &a,
+                        const std::pair<sv_frame_t, sv_frame_t> &b) {
+                         return a.first < b.first;
+                     });
+
+    // Both sequences are sorted, so the point preceding each frame
+    // only ever moves forward
+    
+    size_t i = 0;
+    
+    for (sv_frame_t frame: referenceFrames) {
+        
+        while (i + 1 < reverse.size() && reverse[i + 1].first <= frame) {
+            ++i;
+        }
+
+        const auto &found = reverse[i];
+        const auto &following =
+            (i + 1 < reverse.size() ? reverse[i + 1] : found);
+
+        sv_frame_t out = found.second;
+        if (out < 0) {
+            out = 0;
+        } else if (following.first != found.first && frame > found.first) {
+            double proportion = double(frame - found.first) /
+                double(following.first - found.first);
+            out += sv_frame_t
+                (lrint(double(following.second - found.second) * proportion));
+        }
+        
+        if (out > end) out = end;
+        mapped.push_back(out);
+    }
+
+    return mapped;
+}
+
+EventVector
+AlignmentMapping::eventsFromReference(ModelId alignedModel,
+                                      const EventVector &events,
+                                      bool align)
+{
+    EventVector result;
+    result.reserve(events.size());
+
+    if (!align) {
+        for (const auto &e: events) {
+            result.push_back(e.withLabel(""));
+        }
+        return result;
+    }
+
+    std::vector<sv_frame_t> frames;
+    frames.reserve(events.size());
+    for (const auto &e: events) {
+        frames.push_back(e.getFrame());
+    }
+
+    auto mapped = fromReference(alignedModel, frames);
+
+    for (int i = 0; in_range_for(events, i); ++i) {
+        result.push_back(events[i].withFrame(mapped[i]).withLabel(""));
+    }
+
+    return result;
+}
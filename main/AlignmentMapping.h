@@ -0,0 +1,56 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Lineup
+    Comparative visualisation and alignment of related audio recordings
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef VECT_ALIGNMENT_MAPPING_H
+#define VECT_ALIGNMENT_MAPPING_H
+
+#include "data/model/Model.h"
+#include "base/Event.h"
+
+#include <vector>
+
+/**
+ * Map many frames at once from the reference timeline onto that of
+ * an aligned model.
+ *
+ * Model::alignFromReference looks up the alignment model afresh for
+ * every frame it is asked about, and searches the alignment path for
+ * each one. When mapping a whole layer of events, as for the salient
+ * feature layer, we instead take the path once and merge the sorted
+ * frames against its points in a single pass, interpolating between
+ * points as AlignmentModel does.
+ */
+class AlignmentMapping
+{
+public:
+    /**
+     * Map the given reference frames, which must be sorted in
+     * ascending order, to frames in the aligned model. The result has
+     * one frame per input frame, also in ascending order. If the
+     * model has no alignment, the frames are returned unchanged.
+     */
+    static std::vector<sv_frame_t> fromReference
+    (ModelId alignedModel, const std::vector<sv_frame_t> &referenceFrames);
+
+    /**
+     * Map the frames of the given events, which must be sorted as
+     * returned by getAllEvents(), returning a new set of events
+     * without labels (as any labels described the reference audio).
+     * If align is false, only the labels are removed.
+     */
+    static EventVector eventsFromReference
+    (ModelId alignedModel, const EventVector &events, bool align);
+};
+
+#endif
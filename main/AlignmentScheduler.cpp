@@ -0,0 +1,132 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Lineup
+    Comparative visualisation and alignment of related audio recordings
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "AlignmentScheduler.h"
+
+#include "system/System.h"
+#include "base/Debug.h"
+
+#include <QSettings>
+
+// MATCH analyses frames 20ms apart, with a feature vector of about
+// 84 frequency bins (stored as doubles) per frame, and searches
+// within a band about 10 seconds wide of the diagonal. Each cell in
+// the band holds a distance, an accumulated cost and a direction.
+// Every job extracts the reference's features (and, with pitch
+// comparison, its tuning frequency) for itself, as the plugin has no
+// way to share them between instances, so they are counted in full
+// for each job
+static const double featureRate = 50.0;
+static const size_t featureBytes = 84 * sizeof(double);
+static const size_t bandFrames = 500;
+static const size_t cellBytes = 16;
+
+// Fixed cost of the plugin and its buffers regardless of duration
+static const size_t baseBytes = size_t(32) * 1024 * 1024;
+
+AlignmentScheduler::AlignmentScheduler(int jobLimit) :
+    m_jobLimit(jobLimit < 1 ? 1 : jobLimit),
+    m_memoryLimit(getMemoryLimit()),
+    m_reserved(0)
+{
+}
+
+size_t
+AlignmentScheduler::getMemoryLimit()
+{
+    QSettings settings;
+    settings.beginGroup("Preferences");
+    int mb = settings.value("alignment-memory-limit-mb", 0).toInt();
+    settings.endGroup();
+
+    if (mb <= 0) {
+        ssize_t available = 0, total = 0;
+        GetRealMemoryMBAvailable(available, total);
+        if (total > 0) {
+            mb = int(total / 2);
+        } else {
+            mb = 2048;
+        }
+    }
+
+    return size_t(mb) * 1024 * 1024;
+}
+
+size_t
+AlignmentScheduler::estimatePeakMemory(double referenceSeconds,
+                                       double otherSeconds)
+{
+    if (referenceSeconds < 0) referenceSeconds = 0;
+    if (otherSeconds < 0) otherSeconds = 0;
+
+    size_t frames = size_t((referenceSeconds + otherSeconds) * featureRate);
+
+    return baseBytes + frames * featureBytes + frames * bandFrames * cellBytes;
+}
+
+static double
+getDuration(ModelId modelId)
+{
+    auto model = ModelById::get(modelId);
+    if (!model || model->getSampleRate() <= 0) return 0;
+    return double(model->getEndFrame()) / model->getSampleRate();
+}
+
+bool
+AlignmentScheduler::admit(ModelId reference, ModelId model)
+{
+    if (m_running.find(model) != m_running.end()) {
+        return true;
+    }
+
+    if (int(m_running.size()) >= m_jobLimit) {
+        return false;
+    }
+
+    size_t estimate = estimatePeakMemory(getDuration(reference),
+                                         getDuration(model));
+
+    if (!m_running.empty() && m_reserved + estimate > m_memoryLimit) {
+        SVDEBUG << "AlignmentScheduler: deferring alignment needing about "
+                << estimate / 1048576 << "MB, as " << m_reserved / 1048576
+                << "MB of " << m_memoryLimit / 1048576
+                << "MB is already reserved" << endl;
+        return false;
+    }
+
+    m_running[model] = estimate;
+    m_reserved += estimate;
+
+    SVDEBUG << "AlignmentScheduler: admitted alignment needing about "
+            << estimate / 1048576 << "MB (" << m_running.size()
+            << " running, " << m_reserved / 1048576 << "MB reserved)"
+            << endl;
+
+    return true;
+}
+
+void
+AlignmentScheduler::release(ModelId model)
+{
+    auto itr = m_running.find(model);
+    if (itr == m_running.end()) return;
+    m_reserved -= itr->second;
+    m_running.erase(itr);
+}
+
+int
+AlignmentScheduler::getRunningCount() const
+{
+    return int(m_running.size());
+}
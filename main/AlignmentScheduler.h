@@ -0,0 +1,73 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Lineup
+    Comparative visualisation and alignment of related audio recordings
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef VECT_ALIGNMENT_SCHEDULER_H
+#define VECT_ALIGNMENT_SCHEDULER_H
+
+#include "data/model/Model.h"
+
+#include <map>
+
+/**
+ * Decide how many alignments may run at once, from an estimate of
+ * the peak memory each will need and the number of cores.
+ *
+ * A MATCH alignment holds a feature vector for every frame of both
+ * inputs, plus a band of the cost matrix around the path, so its
+ * peak memory grows with the sum of the two durations. Jobs are
+ * admitted while the total estimate for those running stays within
+ * the "alignment-memory-limit-mb" preference (defaulting to half of
+ * physical memory) and their number within the job limit given on
+ * construction. A single job is always admitted if nothing else is
+ * running, however large it is.
+ */
+class AlignmentScheduler
+{
+public:
+    AlignmentScheduler(int jobLimit);
+
+    /**
+     * Reserve room for aligning the given model against the given
+     * reference and return true, or return false if it does not fit
+     * alongside the jobs already running.
+     */
+    bool admit(ModelId reference, ModelId model);
+
+    /**
+     * Release the room reserved for the given model's alignment.
+     */
+    void release(ModelId model);
+
+    int getRunningCount() const;
+
+    /**
+     * Return the estimated peak memory in bytes of a MATCH alignment
+     * between inputs of the given durations.
+     */
+    static size_t estimatePeakMemory(double referenceSeconds,
+                                     double otherSeconds);
+
+    /**
+     * Return the memory ceiling in bytes for all alignments together.
+     */
+    static size_t getMemoryLimit();
+
+private:
+    int m_jobLimit;
+    size_t m_memoryLimit;
+    size_t m_reserved;
+    std::map<ModelId, size_t> m_running;
+};
+
+#endif
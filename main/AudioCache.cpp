@@ -0,0 +1,531 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Lineup
+    Comparative visualisation and alignment of related audio recordings
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "AudioCache.h"
+
+#include "data/fileio/AudioFileReader.h"
+#include "data/model/WaveFileModel.h"
+#include "base/TempDirectory.h"
+#include "base/TempWriteFile.h"
+#include "base/Exceptions.h"
+#include "base/Debug.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QDataStream>
+#include <QTextStream>
+#include <QCryptographicHash>
+#include <QSettings>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThreadPool>
+
+#include <algorithm>
+#include <cstring>
+
+// Layout of a cache entry: an 8-byte magic number, then a header
+// written with QDataStream, then raw native-endian interleaved float
+// samples starting at a fixed offset so that they can be mapped
+// directly.
+
+static const char *const cacheMagic = "VECTPCM1";
+static const quint32 cacheVersion = 2;
+static const qint64 cacheDataOffset = 4096;
+
+struct CacheHeader
+{
+    quint32 version;
+    quint32 channels;
+    double sampleRate;
+    qint64 frames;
+    QString hash;
+    QString title;
+    QString maker;
+
+    CacheHeader() :
+        version(cacheVersion), channels(0), sampleRate(0), frames(0) { }
+};
+
+static QDataStream &
+operator<<(QDataStream &out, const CacheHeader &h)
+{
+    return out << h.version << h.channels << h.sampleRate << h.frames
+               << h.hash << h.title << h.maker;
+}
+
+static QDataStream &
+operator>>(QDataStream &in, CacheHeader &h)
+{
+    return in >> h.version >> h.channels >> h.sampleRate >> h.frames
+              >> h.hash >> h.title >> h.maker;
+}
+
+class CachedAudioFileReader : public AudioFileReader
+{
+public:
+    CachedAudioFileReader(QString cachePath, QString location) :
+        m_file(cachePath),
+        m_location(location),
+        m_data(nullptr) {
+        m_frameCount = 0;
+        m_channelCount = 0;
+        m_sampleRate = 0;
+    }
+
+    virtual ~CachedAudioFileReader() {
+        if (m_data) {
+            m_file.unmap(reinterpret_cast<uchar *>(m_data));
+        }
+    }
+
+    bool open(QString expectedHash, sv_samplerate_t expectedRate) {
+
+        if (!m_file.open(QIODevice::ReadOnly)) {
+            return false;
+        }
+
+        QByteArray magic = m_file.read(qint64(strlen(cacheMagic)));
+        if (magic != cacheMagic) {
+            SVDEBUG << "CachedAudioFileReader: bad magic in "
+                    << m_file.fileName() << endl;
+            return false;
+        }
+
+        QDataStream stream(&m_file);
+        CacheHeader header;
+        stream >> header;
+
+        if (stream.status() != QDataStream::Ok ||
+            header.version != cacheVersion ||
+            header.hash != expectedHash ||
+            header.channels == 0 ||
+            (expectedRate != 0 && header.sampleRate != expectedRate)) {
+            SVDEBUG << "CachedAudioFileReader: stale or mismatched entry "
+                    << m_file.fileName() << endl;
+            return false;
+        }
+
+        qint64 dataSize =
+            header.frames * qint64(header.channels) * qint64(sizeof(float));
+
+        if (m_file.size() != cacheDataOffset + dataSize) {
+            SVDEBUG << "CachedAudioFileReader: truncated entry "
+                    << m_file.fileName() << endl;
+            return false;
+        }
+
+        if (dataSize > 0) {
+            uchar *mapped = m_file.map(cacheDataOffset, dataSize);
+            if (!mapped) {
+                SVDEBUG << "CachedAudioFileReader: failed to map "
+                        << m_file.fileName() << endl;
+                return false;
+            }
+            m_data = reinterpret_cast<float *>(mapped);
+        }
+
+        m_title = header.title;
+        m_maker = header.maker;
+        m_frameCount = header.frames;
+        m_sampleRate = header.sampleRate;
+        m_channelCount = int(header.channels);
+        return true;
+    }
+
+    QString getLocation() const override { return m_location; }
+    QString getTitle() const override { return m_title; }
+    QString getMaker() const override { return m_maker; }
+
+    bool isQuicklySeekable() const override { return true; }
+    bool hasDelayCompensation() const override { return false; }
+
+    floatvec_t getInterleavedFrames(sv_frame_t start,
+                                    sv_frame_t count) const override {
+        if (!m_data || start < 0 || start >= m_frameCount || count <= 0) {
+            return {};
+        }
+        if (start + count > m_frameCount) {
+            count = m_frameCount - start;
+        }
+        const float *from = m_data + start * m_channelCount;
+        return floatvec_t(from, from + count * m_channelCount);
+    }
+
+private:
+    QFile m_file;
+    QString m_location;
+    QString m_title;
+    QString m_maker;
+    float *m_data;
+};
+
+AudioCache *
+AudioCache::getInstance()
+{
+    static AudioCache instance;
+    return &instance;
+}
+
+AudioCache::AudioCache()
+{
+}
+
+int
+AudioCache::getSizeLimitMB()
+{
+    QSettings settings;
+    settings.beginGroup("Preferences");
+    int limit = settings.value("audio-cache-limit-mb", 8192).toInt();
+    settings.endGroup();
+    return limit;
+}
+
+QString
+AudioCache::getCacheDirectory()
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (m_directory != "") {
+        return m_directory;
+    }
+
+    QDir parentDir(TempDirectory::getInstance()->getContainingPath());
+    QString cacheDirName("cache/audio");
+
+    if (!parentDir.mkpath(cacheDirName + "/index")) {
+        SVCERR << "ERROR: AudioCache: Failed to create cache dir in \""
+               << parentDir.canonicalPath() << "\"" << endl;
+        return {};
+    }
+
+    m_directory = parentDir.filePath(cacheDirName);
+    return m_directory;
+}
+
+QString
+AudioCache::getEntryPath(QString hash, sv_samplerate_t targetRate,
+                         bool normalised)
+{
+    QString dir = getCacheDirectory();
+    if (dir == "" || hash == "") return {};
+
+    return QDir(dir).filePath(QString("%1-%2%3.pcm")
+                              .arg(hash)
+                              .arg(qint64(targetRate))
+                              .arg(normalised ? "-n" : ""));
+}
+
+class AudioCache::HashTask : public QRunnable
+{
+public:
+    HashTask(AudioCache *cache, QString localPath) :
+        m_cache(cache), m_localPath(localPath) { }
+
+    void run() override {
+        m_cache->getContentHash(m_localPath);
+        QMutexLocker locker(&m_cache->m_hashingMutex);
+        m_cache->m_hashing.erase(m_localPath);
+    }
+
+private:
+    AudioCache *m_cache;
+    QString m_localPath;
+};
+
+QString
+AudioCache::getContentHash(QString localPath)
+{
+    return findContentHash(localPath, true);
+}
+
+QString
+AudioCache::getKnownContentHash(QString localPath)
+{
+    return findContentHash(localPath, false);
+}
+
+void
+AudioCache::requestContentHash(QString localPath)
+{
+    if (localPath == "" || getKnownContentHash(localPath) != "") {
+        return;
+    }
+    
+    {
+        QMutexLocker locker(&m_hashingMutex);
+        if (m_hashing.find(localPath) != m_hashing.end()) {
+            return;
+        }
+        m_hashing.insert(localPath);
+    }
+
+    QThreadPool::globalInstance()->start(new HashTask(this, localPath));
+}
+
+QString
+AudioCache::findContentHash(QString localPath, bool calculate)
+{
+    QFileInfo info(localPath);
+    if (!info.exists() || !info.isFile()) {
+        return {};
+    }
+
+    QString dir = getCacheDirectory();
+
+    qint64 size = info.size();
+    qint64 modified = info.lastModified().toMSecsSinceEpoch();
+
+    QString indexPath;
+
+    if (dir != "") {
+        QString pathHash = QCryptographicHash::hash
+            (info.absoluteFilePath().toUtf8(), QCryptographicHash::Sha1)
+            .toHex();
+        indexPath = QDir(dir).filePath("index/" + pathHash);
+
+        QFile indexFile(indexPath);
+        if (indexFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
+            QTextStream in(&indexFile);
+            qint64 indexedSize = -1, indexedModified = -1;
+            QString indexedHash;
+            in >> indexedSize >> indexedModified >> indexedHash;
+            if (indexedSize == size && indexedModified == modified &&
+                indexedHash != "") {
+                return indexedHash;
+            }
+        }
+    }
+
+    if (!calculate) {
+        return {};
+    }
+
+    QFile file(localPath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return {};
+    }
+
+    QCryptographicHash hasher(QCryptographicHash::Sha1);
+    if (!hasher.addData(&file)) {
+        return {};
+    }
+    QString hash = hasher.result().toHex();
+
+    if (indexPath != "") {
+        QFile indexFile(indexPath);
+        if (indexFile.open(QIODevice::WriteOnly | QIODevice::Text)) {
+            QTextStream out(&indexFile);
+            out << size << " " << modified << " " << hash << "\n";
+        }
+    }
+
+    return hash;
+}
+
+AudioFileReader *
+AudioCache::getCachedReader(QString localPath,
+                            QString location,
+                            sv_samplerate_t targetRate,
+                            bool normalised)
+{
+    QString hash = getContentHash(localPath);
+    QString entryPath = getEntryPath(hash, targetRate, normalised);
+    if (entryPath == "" || !QFile(entryPath).exists()) {
+        return nullptr;
+    }
+
+    CachedAudioFileReader *reader =
+        new CachedAudioFileReader(entryPath, location);
+
+    if (!reader->open(hash, targetRate)) {
+        delete reader;
+        QFile::remove(entryPath);
+        return nullptr;
+    }
+
+    // Mark the entry as recently used, for prune()
+    QFile entry(entryPath);
+    if (entry.open(QIODevice::ReadOnly)) {
+        entry.setFileTime(QDateTime::currentDateTime(),
+                          QFileDevice::FileModificationTime);
+    }
+
+    SVDEBUG << "AudioCache: using cached decoding " << entryPath
+            << " for " << location << endl;
+
+    return reader;
+}
+
+void
+AudioCache::store(QString localPath,
+                  const AudioFileReader *reader,
+                  sv_samplerate_t targetRate,
+                  bool normalised)
+{
+    if (!reader || !reader->isOK()) return;
+
+    Source source;
+    source.channels = reader->getChannelCount();
+    source.sampleRate = reader->getSampleRate();
+    source.frames = reader->getFrameCount();
+    source.title = reader->getTitle();
+    source.maker = reader->getMaker();
+    source.read = [reader](sv_frame_t start, sv_frame_t count) {
+        return reader->getInterleavedFrames(start, count);
+    };
+
+    store(localPath, source, targetRate, normalised);
+}
+
+void
+AudioCache::store(QString localPath,
+                  const WaveFileModel *model,
+                  sv_samplerate_t targetRate,
+                  bool normalised)
+{
+    if (!model || !model->isOK() || !model->isReady()) return;
+
+    int channels = model->getChannelCount();
+    if (channels < 1) return;
+
+    Source source;
+    source.channels = channels;
+    source.sampleRate = model->getSampleRate();
+    source.frames = model->getFrameCount();
+    source.title = model->getTitle();
+    source.maker = model->getMaker();
+    source.read = [model, channels](sv_frame_t start, sv_frame_t count) {
+        auto data = model->getMultiChannelData(0, channels - 1, start, count);
+        floatvec_t interleaved;
+        if (data.empty()) return interleaved;
+        sv_frame_t got = sv_frame_t(data[0].size());
+        interleaved.resize(got * channels);
+        for (int c = 0; c < channels && in_range_for(data, c); ++c) {
+            for (sv_frame_t i = 0; i < got && in_range_for(data[c], i); ++i) {
+                interleaved[i * channels + c] = data[c][i];
+            }
+        }
+        return interleaved;
+    };
+
+    store(localPath, source, targetRate, normalised);
+}
+
+void
+AudioCache::store(QString localPath,
+                  const Source &source,
+                  sv_samplerate_t targetRate,
+                  bool normalised)
+{
+    QString hash = getContentHash(localPath);
+    QString entryPath = getEntryPath(hash, targetRate, normalised);
+    if (entryPath == "") return;
+
+    CacheHeader header;
+    header.channels = quint32(source.channels);
+    header.sampleRate = source.sampleRate;
+    header.frames = source.frames;
+    header.hash = hash;
+    header.title = source.title.left(512);
+    header.maker = source.maker.left(512);
+
+    try {
+        TempWriteFile tempFile(entryPath);
+
+        QFile f(tempFile.getTemporaryFilename());
+        if (!f.open(QIODevice::WriteOnly)) {
+            SVCERR << "AudioCache::store: Failed to open temporary file for "
+                   << entryPath << endl;
+            return;
+        }
+
+        f.write(cacheMagic, qint64(strlen(cacheMagic)));
+        QDataStream stream(&f);
+        stream << header;
+
+        if (f.pos() > cacheDataOffset) {
+            SVCERR << "AudioCache::store: Header too long for "
+                   << entryPath << endl;
+            return;
+        }
+        f.seek(cacheDataOffset);
+
+        sv_frame_t blockSize = 1 << 16;
+        sv_frame_t written = 0;
+
+        while (written < header.frames) {
+            sv_frame_t count = std::min(blockSize, header.frames - written);
+            floatvec_t block = source.read(written, count);
+            if (block.empty()) break;
+            qint64 bytes = qint64(block.size() * sizeof(float));
+            if (f.write(reinterpret_cast<const char *>(block.data()), bytes)
+                != bytes) {
+                SVCERR << "AudioCache::store: Write failed for "
+                       << entryPath << endl;
+                return;
+            }
+            written += sv_frame_t(block.size()) / header.channels;
+        }
+
+        if (written != header.frames) {
+            SVCERR << "AudioCache::store: Source returned " << written
+                   << " of " << header.frames << " frames, not caching "
+                   << entryPath << endl;
+            return;
+        }
+
+        f.close();
+        tempFile.moveToTarget();
+
+    } catch (const FileOperationFailed &) {
+        SVCERR << "AudioCache::store: Failed to write cache entry "
+               << entryPath << endl;
+        return;
+    }
+
+    SVDEBUG << "AudioCache: stored " << header.frames << " frames from "
+            << localPath << " in " << entryPath << endl;
+
+    prune();
+}
+
+void
+AudioCache::prune()
+{
+    QString dir = getCacheDirectory();
+    if (dir == "") return;
+
+    QMutexLocker locker(&m_mutex);
+
+    qint64 limit = qint64(getSizeLimitMB()) * 1024 * 1024;
+
+    QFileInfoList entries = QDir(dir).entryInfoList
+        (QStringList() << "*.pcm", QDir::Files, QDir::Time | QDir::Reversed);
+
+    qint64 total = 0;
+    for (const auto &e: entries) {
+        total += e.size();
+    }
+
+    // Least recently used first, thanks to QDir::Reversed, as
+    // getCachedReader touches each entry it uses
+    for (const auto &e: entries) {
+        if (total <= limit) break;
+        SVDEBUG << "AudioCache: pruning " << e.filePath() << endl;
+        total -= e.size();
+        QFile::remove(e.filePath());
+    }
+}
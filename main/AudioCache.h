@@ -0,0 +1,135 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Lineup
+    Comparative visualisation and alignment of related audio recordings
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef VECT_AUDIO_CACHE_H
+#define VECT_AUDIO_CACHE_H
+
+#include <QString>
+#include <QMutex>
+
+#include "base/BaseTypes.h"
+
+#include <functional>
+#include <set>
+
+class AudioFileReader;
+class WaveFileModel;
+
+/**
+ * Persistent cache of decoded and resampled audio, stored as raw
+ * interleaved float files in a "cache" directory alongside the
+ * temporary directory. Entries are keyed by the SHA-1 of the source
+ * file's contents together with the target rate and normalisation,
+ * so a file that has been moved or re-downloaded still hits the
+ * cache. Cached audio is memory-mapped rather than read in.
+ *
+ * All methods are thread-safe.
+ */
+class AudioCache
+{
+public:
+    static AudioCache *getInstance();
+
+    /**
+     * Return the SHA-1 (as a hex string) of the contents of the
+     * given local file, or an empty string if it can't be read. The
+     * hash is remembered against the file's path, size and
+     * modification time, so an unchanged file is only hashed once.
+     */
+    QString getContentHash(QString localPath);
+
+    /**
+     * Return the SHA-1 of the contents of the given local file if it
+     * is already known, without reading the file, or an empty string
+     * otherwise. Files decoded through the SessionLoader are always
+     * known. This is cheap enough to call from the GUI thread.
+     */
+    QString getKnownContentHash(QString localPath);
+
+    /**
+     * Start calculating the SHA-1 of the given local file in the
+     * background, if it is not already known or being calculated,
+     * so that getKnownContentHash will return it later.
+     */
+    void requestContentHash(QString localPath);
+
+    /**
+     * Return a reader for the cached decoding of the given local
+     * file at the given rate, or nullptr if there is none. The
+     * location is reported through AudioFileReader::getLocation.
+     */
+    AudioFileReader *getCachedReader(QString localPath,
+                                     QString location,
+                                     sv_samplerate_t targetRate,
+                                     bool normalised);
+
+    /**
+     * Write the entire contents of the given reader into the cache
+     * as the decoding of the given local file. Failures are logged
+     * and otherwise ignored.
+     */
+    void store(QString localPath,
+               const AudioFileReader *reader,
+               sv_samplerate_t targetRate,
+               bool normalised);
+
+    /**
+     * Write the entire contents of the given model into the cache
+     * as the decoding of the given local file. This is for readers
+     * that decode in the background, whose audio is only complete
+     * once the model wrapping them is ready; nothing is written if
+     * the model is not yet ready.
+     */
+    void store(QString localPath,
+               const WaveFileModel *model,
+               sv_samplerate_t targetRate,
+               bool normalised);
+
+    /**
+     * Return the maximum size of the cache in megabytes, from the
+     * "audio-cache-limit-mb" preference.
+     */
+    static int getSizeLimitMB();
+
+private:
+    AudioCache();
+
+    struct Source {
+        int channels;
+        sv_samplerate_t sampleRate;
+        sv_frame_t frames;
+        QString title;
+        QString maker;
+        std::function<floatvec_t(sv_frame_t, sv_frame_t)> read;
+    };
+
+    void store(QString localPath, const Source &source,
+               sv_samplerate_t targetRate, bool normalised);
+
+    class HashTask;
+
+    QString findContentHash(QString localPath, bool calculate);
+    QString getCacheDirectory();
+    QString getEntryPath(QString hash, sv_samplerate_t targetRate,
+                         bool normalised);
+    void prune();
+
+    QMutex m_mutex;
+    QString m_directory;
+
+    QMutex m_hashingMutex;
+    std::set<QString> m_hashing;
+};
+
+#endif
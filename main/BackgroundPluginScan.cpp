@@ -0,0 +1,128 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Lineup
+    Comparative visualisation and alignment of related audio recordings
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "BackgroundPluginScan.h"
+
+#include "svcore/plugin/PluginScan.h"
+#include "base/Debug.h"
+
+#include "../version.h"
+
+#include <vamp-hostsdk/PluginHostAdapter.h>
+
+#include <QThread>
+#include <QSettings>
+#include <QDir>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QStringList>
+#include <QCryptographicHash>
+
+class PluginScanThread : public QThread
+{
+public:
+    void run() override {
+        PluginScan::getInstance()->scan();
+    }
+};
+
+static PluginScanThread *scanThread = nullptr;
+static QString scanSignature;
+
+QString
+BackgroundPluginScan::getLibrarySignature()
+{
+    QStringList entries;
+
+#ifdef Q_OS_WIN32
+    QStringList filters { "*.dll" };
+#else
+#ifdef Q_OS_MAC
+    QStringList filters { "*.dylib", "*.so" };
+#else
+    QStringList filters { "*.so" };
+#endif
+#endif
+
+    auto path = Vamp::PluginHostAdapter::getPluginPath();
+
+    for (const auto &dirName: path) {
+        QDir dir(QString::fromStdString(dirName));
+        if (!dir.exists()) continue;
+        for (const auto &fi: dir.entryInfoList(filters, QDir::Files,
+                                               QDir::Name)) {
+            entries.push_back(QString("%1|%2|%3")
+                              .arg(fi.absoluteFilePath())
+                              .arg(fi.size())
+                              .arg(fi.lastModified().toMSecsSinceEpoch()));
+        }
+    }
+
+    // A new version of the application may bring a new checker
+    // helper, so it invalidates the signature too
+    entries.push_back(QString("version|%1").arg(VECT_VERSION));
+
+    return QCryptographicHash::hash
+        (entries.join("\n").toUtf8(), QCryptographicHash::Sha1).toHex();
+}
+
+void
+BackgroundPluginScan::start()
+{
+    scanSignature = getLibrarySignature();
+
+    QSettings settings;
+    settings.beginGroup("PluginScan");
+    QString previous = settings.value("library-signature", "").toString();
+    settings.endGroup();
+
+    if (previous != "" && previous == scanSignature) {
+        SVDEBUG << "BackgroundPluginScan: plugin libraries unchanged, "
+                << "scanning in background" << endl;
+        scanThread = new PluginScanThread;
+        scanThread->start();
+        return;
+    }
+
+    SVDEBUG << "BackgroundPluginScan: plugin libraries have changed, "
+            << "scanning synchronously" << endl;
+    PluginScan::getInstance()->scan();
+    wait();
+}
+
+void
+BackgroundPluginScan::wait()
+{
+    if (scanThread) {
+        scanThread->wait();
+        delete scanThread;
+        scanThread = nullptr;
+    }
+
+    if (scanSignature == "") {
+        return;
+    }
+
+    // Only a clean scan is worth trusting next time
+    QSettings settings;
+    settings.beginGroup("PluginScan");
+    if (PluginScan::getInstance()->scanSucceeded()) {
+        settings.setValue("library-signature", scanSignature);
+    } else {
+        settings.remove("library-signature");
+    }
+    settings.endGroup();
+
+    scanSignature = "";
+}
@@ -0,0 +1,54 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Lineup
+    Comparative visualisation and alignment of related audio recordings
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef VECT_BACKGROUND_PLUGIN_SCAN_H
+#define VECT_BACKGROUND_PLUGIN_SCAN_H
+
+#include <QString>
+
+/**
+ * Run the startup plugin scan, in the background where it is safe
+ * to do so.
+ *
+ * A signature of the installed Vamp plugin libraries (path, size and
+ * modification time of each) is recorded after every successful
+ * scan. If the libraries are unchanged at the next startup, the scan
+ * is expected to succeed as before and can overlap with the rest of
+ * startup; if anything has changed, it is run synchronously as it
+ * always used to be, so that any failures are reported before the
+ * main window appears.
+ */
+class BackgroundPluginScan
+{
+public:
+    /**
+     * Start the scan, returning immediately if it can be run in the
+     * background or once it is complete otherwise.
+     */
+    static void start();
+
+    /**
+     * Wait for a scan started by start() to complete. Must be called
+     * before anything that needs the scan results.
+     */
+    static void wait();
+
+    /**
+     * Return a signature string identifying the set of plugin
+     * libraries currently installed on the Vamp path.
+     */
+    static QString getLibrarySignature();
+};
+
+#endif
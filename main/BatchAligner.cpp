@@ -0,0 +1,458 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Lineup
+    Comparative visualisation and alignment of related audio recordings
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "BatchAligner.h"
+#include "SessionLoader.h"
+#include "AudioCache.h"
+#include "AlignmentCache.h"
+
+#include "framework/Document.h"
+#include "align/Align.h"
+#include "data/model/ReadOnlyWaveFileModel.h"
+#include "data/model/AlignmentModel.h"
+#include "data/fileio/FileSource.h"
+#include "base/Preferences.h"
+#include "base/Debug.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QSettings>
+#include <QThread>
+
+static QString
+csvQuote(QString s)
+{
+    s.replace("\"", "\"\"");
+    return "\"" + s + "\"";
+}
+
+BatchAligner::BatchAligner(QString referencePath,
+                           std::vector<QString> paths,
+                           QString outputDirectory,
+                           QObject *parent) :
+    QObject(parent),
+    m_referencePath(referencePath),
+    m_outputDirectory(outputDirectory),
+    m_scheduler(getConcurrencyLimit()),
+    m_loadingReference(true),
+    m_loadComplete(false),
+    m_failed(false),
+    m_document(new Document),
+    m_align(new Align),
+    m_loader(new SessionLoader(this))
+{
+    for (auto p: paths) {
+        Track t;
+        t.path = p;
+        m_tracks.push_back(t);
+    }
+
+    // Same default as the interactive application
+    Align::setDefaultAlignmentPreference(Align::MATCHAlignmentWithPitchCompare);
+
+    connect(m_loader,
+            SIGNAL(fileReady(int, QString, FileSource *, AudioFileReader *)),
+            this,
+            SLOT(fileReady(int, QString, FileSource *, AudioFileReader *)));
+    connect(m_loader, SIGNAL(fileFailed(int, QString, QString)),
+            this, SLOT(fileFailed(int, QString, QString)));
+    connect(m_loader, SIGNAL(finished()),
+            this, SLOT(loadFinished()));
+
+    connect(m_align, SIGNAL(alignmentComplete(ModelId)),
+            this, SLOT(alignmentComplete(ModelId)));
+    connect(m_align, SIGNAL(alignmentFailed(ModelId, QString)),
+            this, SLOT(alignmentFailed(ModelId, QString)));
+}
+
+BatchAligner::~BatchAligner()
+{
+    m_loader->cancel();
+    delete m_align;
+    for (const auto &t: m_tracks) {
+        if (!t.model.isNone()) {
+            ModelById::release(t.model);
+        }
+    }
+    delete m_document;
+}
+
+int
+BatchAligner::getConcurrencyLimit()
+{
+    QSettings settings;
+    settings.beginGroup("Preferences");
+    int limit = settings.value("batch-alignment-concurrency",
+                               QThread::idealThreadCount()).toInt();
+    settings.endGroup();
+    if (limit < 1) limit = 1;
+    return limit;
+}
+
+void
+BatchAligner::start()
+{
+    m_clock.start();
+
+    if (!QDir().mkpath(m_outputDirectory)) {
+        SVCERR << "ERROR: BatchAligner: Failed to create output directory \""
+               << m_outputDirectory << "\"" << endl;
+        emit finished(1);
+        return;
+    }
+
+    SVCERR << "BatchAligner: aligning " << m_tracks.size()
+           << " file(s) against \"" << m_referencePath << "\" using "
+           << Align::getAlignmentTypeTag(Align::getAlignmentPreference())
+           << ", up to " << getConcurrencyLimit() << " at once within "
+           << AlignmentScheduler::getMemoryLimit() / 1048576 << "MB" << endl;
+
+    m_loadingReference = true;
+    m_loader->load({ m_referencePath }, 0);
+}
+
+void
+BatchAligner::fileReady(int index, QString path,
+                        FileSource *source, AudioFileReader *reader)
+{
+    auto model = std::make_shared<ReadOnlyWaveFileModel>(*source, reader);
+    delete source;
+
+    ModelId modelId = ModelById::add(model);
+    m_loader->trackModel(modelId);
+
+    if (m_loadingReference) {
+        m_referenceModel = modelId;
+        m_document->setMainModel(modelId);
+        return;
+    }
+
+    if (!in_range_for(m_tracks, index)) {
+        ModelById::release(modelId);
+        return;
+    }
+
+    Track &t = m_tracks[index];
+    t.model = modelId;
+
+    QString key = getAlignmentCacheKey(modelId);
+    if (key != "" &&
+        AlignmentCache::getInstance()->restore(key, m_referenceModel, modelId)) {
+        SVDEBUG << "BatchAligner: using cached alignment for \"" << path
+                << "\"" << endl;
+        t.cached = true;
+    }
+
+    // The model may still be decoding progressively, in which case
+    // neither an alignment nor the path written from a cached one
+    // can be complete until it is ready
+    if (model->isReady()) {
+        modelReady(modelId);
+    } else {
+        connect(model.get(), SIGNAL(ready(ModelId)),
+                this, SLOT(modelReady(ModelId)));
+    }
+}
+
+void
+BatchAligner::fileFailed(int index, QString path, QString error)
+{
+    SVCERR << "ERROR: BatchAligner: Failed to load \"" << path << "\": "
+           << error << endl;
+
+    m_failed = true;
+
+    if (m_loadingReference) {
+        emit finished(1);
+        return;
+    }
+
+    if (in_range_for(m_tracks, index)) {
+        m_tracks[index].error = error;
+        trackFinished(index);
+    }
+}
+
+void
+BatchAligner::loadFinished()
+{
+    if (m_loadingReference) {
+
+        if (m_referenceModel.isNone()) {
+            // Already reported through fileFailed
+            return;
+        }
+
+        m_loadingReference = false;
+
+        sv_samplerate_t targetRate = 0;
+        auto reference = ModelById::get(m_referenceModel);
+        if (Preferences::getInstance()->getResampleOnLoad() && reference) {
+            targetRate = reference->getSampleRate();
+        }
+
+        std::vector<QString> paths;
+        for (const auto &t: m_tracks) {
+            paths.push_back(t.path);
+        }
+        m_loader->load(paths, targetRate);
+        return;
+    }
+
+    m_loadComplete = true;
+    checkFinished();
+}
+
+void
+BatchAligner::modelReady(ModelId modelId)
+{
+    int index = findTrack(modelId);
+    if (index < 0 || m_tracks[index].done) return;
+
+    Track &t = m_tracks[index];
+    t.readyAt = double(m_clock.elapsed()) / 1000.0;
+
+    if (t.cached) {
+        trackFinished(index);
+        return;
+    }
+    
+    m_waiting.push_back(index);
+    admit();
+}
+
+void
+BatchAligner::admit()
+{
+    // Files are started in the order they became ready; one that
+    // doesn't fit yet holds up the rest until something finishes
+
+    while (!m_waiting.empty()) {
+
+        int index = m_waiting.front();
+        Track &t = m_tracks[index];
+
+        if (!m_scheduler.admit(m_referenceModel, t.model)) {
+            break;
+        }
+
+        m_waiting.pop_front();
+        t.timer.start();
+
+        SVDEBUG << "BatchAligner: starting alignment of \"" << t.path
+                << "\" (" << m_scheduler.getRunningCount() << " running)"
+                << endl;
+
+        QString error;
+        if (!m_align->alignModel(m_document, m_referenceModel, t.model,
+                                 error)) {
+            m_scheduler.release(t.model);
+            m_failed = true;
+            t.error = error;
+            trackFinished(index);
+        }
+    }
+}
+
+void
+BatchAligner::alignmentComplete(ModelId alignmentModelId)
+{
+    auto am = ModelById::getAs<AlignmentModel>(alignmentModelId);
+    if (!am) return;
+
+    int index = findTrack(am->getAlignedModel());
+    if (index < 0 || m_tracks[index].done) return;
+
+    Track &t = m_tracks[index];
+    t.alignSeconds = double(t.timer.elapsed()) / 1000.0;
+    m_scheduler.release(t.model);
+
+    QString key = getAlignmentCacheKey(t.model);
+    if (key != "") {
+        AlignmentCache::getInstance()->store(key, t.model);
+    }
+
+    trackFinished(index);
+    admit();
+}
+
+void
+BatchAligner::alignmentFailed(ModelId modelId, QString error)
+{
+    // We may be given either the aligned model or its alignment model
+    auto am = ModelById::getAs<AlignmentModel>(modelId);
+    if (am) {
+        modelId = am->getAlignedModel();
+    }
+
+    int index = findTrack(modelId);
+    if (index < 0 || m_tracks[index].done) return;
+
+    Track &t = m_tracks[index];
+    t.alignSeconds = double(t.timer.elapsed()) / 1000.0;
+    t.error = error;
+    m_failed = true;
+    m_scheduler.release(t.model);
+
+    trackFinished(index);
+    admit();
+}
+
+void
+BatchAligner::trackFinished(int index)
+{
+    Track &t = m_tracks[index];
+    t.done = true;
+
+    if (t.error == "") {
+        if (!writePath(t, index)) {
+            t.error = tr("Failed to write alignment path");
+            m_failed = true;
+        }
+    }
+
+    if (t.error == "") {
+        SVCERR << "BatchAligner: aligned \"" << t.path << "\""
+               << (t.cached ? " (cached)" : "") << endl;
+    } else {
+        SVCERR << "ERROR: BatchAligner: failed to align \"" << t.path
+               << "\": " << t.error << endl;
+    }
+
+    // The audio and its alignment are no longer needed, and for
+    // long runs we can't afford to keep them all around
+    if (!t.model.isNone()) {
+        if (auto model = ModelById::get(t.model)) {
+            ModelId alignment = model->getAlignment();
+            if (!alignment.isNone()) {
+                model->setAlignment({});
+                ModelById::release(alignment);
+            }
+        }
+        ModelById::release(t.model);
+        t.model = {};
+    }
+
+    checkFinished();
+}
+
+void
+BatchAligner::checkFinished()
+{
+    if (!m_loadComplete) return;
+
+    for (const auto &t: m_tracks) {
+        if (!t.done) return;
+    }
+
+    if (!writeTimings()) {
+        m_failed = true;
+    }
+
+    SVCERR << "BatchAligner: finished in "
+           << double(m_clock.elapsed()) / 1000.0 << " sec" << endl;
+
+    emit finished(m_failed ? 1 : 0);
+}
+
+int
+BatchAligner::findTrack(ModelId modelId) const
+{
+    if (modelId.isNone()) return -1;
+    for (int i = 0; in_range_for(m_tracks, i); ++i) {
+        if (m_tracks[i].model == modelId) return i;
+    }
+    return -1;
+}
+
+QString
+BatchAligner::getAlignmentCacheKey(ModelId modelId) const
+{
+    auto reference = ModelById::getAs<ReadOnlyWaveFileModel>(m_referenceModel);
+    auto model = ModelById::getAs<ReadOnlyWaveFileModel>(modelId);
+    if (!reference || !model) return {};
+
+    AudioCache *ac = AudioCache::getInstance();
+
+    return AlignmentCache::getInstance()->makeKey
+        (ac->getContentHash(reference->getLocalFilename()),
+         ac->getContentHash(model->getLocalFilename()),
+         Align::getAlignmentPreference(),
+         Align::getUseSubsequenceAlignment());
+}
+
+bool
+BatchAligner::writePath(const Track &t, int index)
+{
+    auto reference = ModelById::get(m_referenceModel);
+    auto model = ModelById::get(t.model);
+    if (!reference || !model) return false;
+
+    QString name = QString("%1-%2.csv")
+        .arg(index + 1, 4, 10, QChar('0'))
+        .arg(QFileInfo(t.path).completeBaseName());
+
+    QFile f(QDir(m_outputDirectory).filePath(name));
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        return false;
+    }
+
+    QTextStream out(&f);
+    out << "time,reference_time\n";
+
+    // One row every 10ms of the aligned audio
+    sv_samplerate_t rate = model->getSampleRate();
+    sv_samplerate_t referenceRate = reference->getSampleRate();
+    sv_frame_t step = sv_frame_t(rate / 100);
+    if (step < 1) step = 1;
+    sv_frame_t end = model->getEndFrame();
+
+    for (sv_frame_t frame = 0; ; frame += step) {
+        if (frame > end) frame = end;
+        sv_frame_t mapped = model->alignToReference(frame);
+        out << double(frame) / rate << ","
+            << double(mapped) / referenceRate << "\n";
+        if (frame == end) break;
+    }
+
+    return true;
+}
+
+bool
+BatchAligner::writeTimings()
+{
+    QFile f(QDir(m_outputDirectory).filePath("timings.csv"));
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        SVCERR << "ERROR: BatchAligner: Failed to write timings file" << endl;
+        return false;
+    }
+
+    QTextStream out(&f);
+    out << "index,file,status,cached,ready_at,align_seconds,error\n";
+
+    for (int i = 0; in_range_for(m_tracks, i); ++i) {
+        const Track &t = m_tracks[i];
+        out << (i + 1) << ","
+            << csvQuote(t.path) << ","
+            << (t.error == "" ? "ok" : "failed") << ","
+            << (t.cached ? 1 : 0) << ","
+            << t.readyAt << ","
+            << t.alignSeconds << ","
+            << csvQuote(t.error) << "\n";
+    }
+
+    return true;
+}
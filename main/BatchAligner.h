@@ -0,0 +1,118 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Lineup
+    Comparative visualisation and alignment of related audio recordings
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef VECT_BATCH_ALIGNER_H
+#define VECT_BATCH_ALIGNER_H
+
+#include <QObject>
+#include <QString>
+#include <QElapsedTimer>
+
+#include "data/model/Model.h"
+
+#include "AlignmentScheduler.h"
+
+#include <vector>
+#include <deque>
+
+class Document;
+class Align;
+class SessionLoader;
+class FileSource;
+class AudioFileReader;
+
+/**
+ * Align a set of audio files against a reference without any user
+ * interface, for use from the command line.
+ *
+ * Files are decoded through a SessionLoader and aligned using the
+ * configured alignment method, with as many alignments running at
+ * once as the AlignmentScheduler allows within getConcurrencyLimit()
+ * jobs and its memory ceiling. For each file a CSV of its alignment
+ * path is written to the output directory, together with a
+ * timings.csv summarising the whole run.
+ */
+class BatchAligner : public QObject
+{
+    Q_OBJECT
+
+public:
+    BatchAligner(QString referencePath,
+                 std::vector<QString> paths,
+                 QString outputDirectory,
+                 QObject *parent = 0);
+    virtual ~BatchAligner();
+
+    /**
+     * Return the number of alignments to run at once, from the
+     * "batch-alignment-concurrency" preference, defaulting to the
+     * number of available cores.
+     */
+    static int getConcurrencyLimit();
+
+public slots:
+    void start();
+
+signals:
+    /**
+     * Emitted when every file has been aligned or has failed, with
+     * an exit code that is non-zero if anything failed.
+     */
+    void finished(int exitCode);
+
+protected slots:
+    void fileReady(int, QString, FileSource *, AudioFileReader *);
+    void fileFailed(int, QString, QString);
+    void loadFinished();
+    void modelReady(ModelId);
+    void alignmentComplete(ModelId);
+    void alignmentFailed(ModelId, QString);
+
+protected:
+    struct Track {
+        QString path;
+        ModelId model;
+        bool done;
+        bool cached;
+        QString error;
+        double readyAt;
+        double alignSeconds;
+        QElapsedTimer timer;
+        Track() : done(false), cached(false), readyAt(0), alignSeconds(0) { }
+    };
+
+    void admit();
+    void trackFinished(int index);
+    void checkFinished();
+    int findTrack(ModelId model) const;
+    QString getAlignmentCacheKey(ModelId model) const;
+    bool writePath(const Track &track, int index);
+    bool writeTimings();
+
+    QString m_referencePath;
+    QString m_outputDirectory;
+    std::vector<Track> m_tracks;
+    std::deque<int> m_waiting;
+    AlignmentScheduler m_scheduler;
+    bool m_loadingReference;
+    bool m_loadComplete;
+    bool m_failed;
+    ModelId m_referenceModel;
+    QElapsedTimer m_clock;
+    Document *m_document;
+    Align *m_align;
+    SessionLoader *m_loader;
+};
+
+#endif
@@ -0,0 +1,417 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Lineup
+    Comparative visualisation and alignment of related audio recordings
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "FeatureCache.h"
+
+#include "data/model/SparseTimeValueModel.h"
+#include "data/model/EditableDenseThreeDimensionalModel.h"
+#include "base/TempDirectory.h"
+#include "base/TempWriteFile.h"
+#include "base/Exceptions.h"
+#include "base/Debug.h"
+
+#include <QDir>
+#include <QFile>
+#include <QDateTime>
+#include <QDataStream>
+#include <QCryptographicHash>
+#include <QSettings>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QPointer>
+#include <QCoreApplication>
+
+#include <cstring>
+
+static const char *const featureMagic = "VECTFEA1";
+static const quint32 featureVersion = 1;
+
+enum FeatureModelType : quint32 {
+    SparseTimeValueType = 1,
+    DenseThreeDimensionalType = 2
+};
+
+FeatureCache *
+FeatureCache::getInstance()
+{
+    static FeatureCache instance;
+    return &instance;
+}
+
+FeatureCache::FeatureCache()
+{
+}
+
+QString
+FeatureCache::getCacheDirectory()
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (m_directory != "") {
+        return m_directory;
+    }
+
+    QDir parentDir(TempDirectory::getInstance()->getContainingPath());
+    QString cacheDirName("cache/features");
+
+    if (!parentDir.mkpath(cacheDirName)) {
+        SVCERR << "ERROR: FeatureCache: Failed to create cache dir in \""
+               << parentDir.canonicalPath() << "\"" << endl;
+        return {};
+    }
+
+    m_directory = parentDir.filePath(cacheDirName);
+    return m_directory;
+}
+
+int
+FeatureCache::getSizeLimitMB()
+{
+    QSettings settings;
+    settings.beginGroup("Preferences");
+    int limit = settings.value("feature-cache-limit-mb", 2048).toInt();
+    settings.endGroup();
+    return limit;
+}
+
+QString
+FeatureCache::getEntryPath(QString key)
+{
+    QString dir = getCacheDirectory();
+    if (dir == "" || key == "") return {};
+
+    QString name = QCryptographicHash::hash
+        (key.toUtf8(), QCryptographicHash::Sha1).toHex();
+    return QDir(dir).filePath(name + ".features");
+}
+
+QString
+FeatureCache::makeKey(const Transform &transform,
+                      QString audioHash,
+                      sv_samplerate_t audioRate,
+                      bool normalised)
+{
+    if (audioHash == "") return {};
+
+    // The transform's XML covers the identifier, plugin version,
+    // parameters, program and step and block sizes
+    return QString("%1|%2|%3|%4")
+        .arg(audioHash)
+        .arg(audioRate)
+        .arg(normalised ? "peak" : "none")
+        .arg(transform.toXmlString());
+}
+
+class FeatureCache::StoreTask : public QRunnable
+{
+public:
+    StoreTask(FeatureCache *cache, QString key, ModelId model) :
+        m_cache(cache), m_key(key), m_model(model) { }
+
+    void run() override {
+        m_cache->write(m_key, m_model);
+    }
+
+private:
+    FeatureCache *m_cache;
+    QString m_key;
+    ModelId m_model;
+};
+
+void
+FeatureCache::store(QString key, ModelId modelId)
+{
+    QThreadPool::globalInstance()->start(new StoreTask(this, key, modelId));
+}
+
+void
+FeatureCache::write(QString key, ModelId modelId)
+{
+    QString entryPath = getEntryPath(key);
+    if (entryPath == "") return;
+
+    auto sparse = ModelById::getAs<SparseTimeValueModel>(modelId);
+    auto dense = ModelById::getAs<EditableDenseThreeDimensionalModel>(modelId);
+    if (!sparse && !dense) {
+        SVDEBUG << "FeatureCache::store: Unsupported model type for "
+                << modelId << ", not caching" << endl;
+        return;
+    }
+
+    try {
+        TempWriteFile tempFile(entryPath);
+
+        QFile f(tempFile.getTemporaryFilename());
+        if (!f.open(QIODevice::WriteOnly)) {
+            SVCERR << "FeatureCache::store: Failed to open temporary file for "
+                   << entryPath << endl;
+            return;
+        }
+
+        QDataStream out(&f);
+        out.writeRawData(featureMagic, int(strlen(featureMagic)));
+        out << featureVersion << key;
+
+        if (sparse) {
+            EventVector events = sparse->getAllEvents();
+            out << quint32(SparseTimeValueType)
+                << double(sparse->getSampleRate())
+                << qint32(sparse->getResolution())
+                << sparse->getScaleUnits()
+                << quint32(events.size());
+            for (const auto &e: events) {
+                out << qint64(e.getFrame()) << e.getValue() << e.getLabel();
+            }
+        } else {
+            int width = dense->getWidth();
+            int height = dense->getHeight();
+            out << quint32(DenseThreeDimensionalType)
+                << double(dense->getSampleRate())
+                << qint32(dense->getResolution())
+                << qint32(height)
+                << qint64(dense->getStartFrame())
+                << dense->getMinimumLevel()
+                << dense->getMaximumLevel();
+            for (int i = 0; i < height; ++i) {
+                out << dense->getBinName(i);
+            }
+            out << qint32(width);
+            for (int x = 0; x < width; ++x) {
+                auto column = dense->getColumn(x);
+                out << quint32(column.size());
+                for (float v: column) {
+                    out << v;
+                }
+            }
+        }
+
+        f.close();
+        tempFile.moveToTarget();
+
+    } catch (const FileOperationFailed &) {
+        SVCERR << "FeatureCache::store: Failed to write cache entry "
+               << entryPath << endl;
+        return;
+    }
+
+    SVDEBUG << "FeatureCache: stored model " << modelId << " in "
+            << entryPath << endl;
+
+    prune();
+}
+
+void
+FeatureCache::prune()
+{
+    QString dir = getCacheDirectory();
+    if (dir == "") return;
+
+    QMutexLocker locker(&m_mutex);
+
+    qint64 limit = qint64(getSizeLimitMB()) * 1024 * 1024;
+
+    QFileInfoList entries = QDir(dir).entryInfoList
+        (QStringList() << "*.features", QDir::Files,
+         QDir::Time | QDir::Reversed);
+
+    qint64 total = 0;
+    for (const auto &e: entries) {
+        total += e.size();
+    }
+
+    // Least recently used first, as read() touches each entry it
+    // restores
+    for (const auto &e: entries) {
+        if (total <= limit) break;
+        SVDEBUG << "FeatureCache: pruning " << e.filePath() << endl;
+        total -= e.size();
+        QFile::remove(e.filePath());
+    }
+}
+
+bool
+FeatureCache::contains(QString key)
+{
+    QString entryPath = getEntryPath(key);
+    if (entryPath == "") return false;
+    return QFile(entryPath).exists();
+}
+
+ModelId
+FeatureCache::restore(QString key, ModelId source)
+{
+    auto model = read(key, source);
+    if (!model) return {};
+    return ModelById::add(model);
+}
+
+class FeatureCache::RestoreTask : public QRunnable
+{
+public:
+    RestoreTask(FeatureCache *cache, QString key, ModelId source,
+                QObject *receiver, const char *slotName) :
+        m_cache(cache), m_key(key), m_source(source),
+        m_receiver(receiver), m_slotName(slotName) { }
+
+    void run() override {
+        ModelId modelId;
+        auto model = m_cache->read(m_key, m_source);
+        if (model) {
+            // Models belong to the GUI thread, not to the pool
+            model->moveToThread(QCoreApplication::instance()->thread());
+            modelId = ModelById::add(model);
+        }
+        if (!m_receiver ||
+            !QMetaObject::invokeMethod(m_receiver, m_slotName.data(),
+                                       Qt::QueuedConnection,
+                                       Q_ARG(QString, m_key),
+                                       Q_ARG(ModelId, m_source),
+                                       Q_ARG(ModelId, modelId))) {
+            if (!modelId.isNone()) ModelById::release(modelId);
+        }
+    }
+
+private:
+    FeatureCache *m_cache;
+    QString m_key;
+    ModelId m_source;
+    QPointer<QObject> m_receiver;
+    QByteArray m_slotName;
+};
+
+void
+FeatureCache::requestRestore(QString key, ModelId source,
+                             QObject *receiver, const char *slotName)
+{
+    QThreadPool::globalInstance()->start
+        (new RestoreTask(this, key, source, receiver, slotName));
+}
+
+std::shared_ptr<Model>
+FeatureCache::read(QString key, ModelId source)
+{
+    QString entryPath = getEntryPath(key);
+    if (entryPath == "") return {};
+
+    QFile f(entryPath);
+    if (!f.open(QIODevice::ReadOnly)) {
+        return {};
+    }
+
+    // Mark the entry as recently used, for prune()
+    f.setFileTime(QDateTime::currentDateTime(),
+                  QFileDevice::FileModificationTime);
+
+    QDataStream in(&f);
+
+    QByteArray magic(int(strlen(featureMagic)), '\0');
+    in.readRawData(magic.data(), magic.size());
+
+    quint32 version = 0;
+    QString storedKey;
+    quint32 type = 0;
+    in >> version >> storedKey >> type;
+
+    if (magic != featureMagic ||
+        version != featureVersion ||
+        storedKey != key ||
+        in.status() != QDataStream::Ok) {
+        SVDEBUG << "FeatureCache: stale or mismatched entry "
+                << entryPath << endl;
+        return {};
+    }
+
+    double sampleRate = 0;
+    qint32 resolution = 0;
+
+    if (type == SparseTimeValueType) {
+
+        QString units;
+        quint32 count = 0;
+        in >> sampleRate >> resolution >> units >> count;
+
+        auto model = std::make_shared<SparseTimeValueModel>
+            (sampleRate, resolution, false);
+        model->setScaleUnits(units);
+
+        for (quint32 i = 0; i < count; ++i) {
+            qint64 frame = 0;
+            float value = 0.f;
+            QString label;
+            in >> frame >> value >> label;
+            model->add(Event(frame, value, label));
+        }
+
+        if (in.status() != QDataStream::Ok) {
+            SVDEBUG << "FeatureCache: truncated entry " << entryPath << endl;
+            return {};
+        }
+
+        model->setSourceModel(source);
+        model->setCompletion(100);
+        return model;
+
+    } else if (type == DenseThreeDimensionalType) {
+
+        qint32 height = 0, width = 0;
+        qint64 startFrame = 0;
+        float minLevel = 0.f, maxLevel = 0.f;
+        in >> sampleRate >> resolution >> height >> startFrame
+           >> minLevel >> maxLevel;
+
+        if (height <= 0 || in.status() != QDataStream::Ok) {
+            SVDEBUG << "FeatureCache: bad entry " << entryPath << endl;
+            return {};
+        }
+
+        auto model = std::make_shared<EditableDenseThreeDimensionalModel>
+            (sampleRate, resolution, height, false);
+        model->setStartFrame(startFrame);
+        model->setMinimumLevel(minLevel);
+        model->setMaximumLevel(maxLevel);
+
+        for (int i = 0; i < height; ++i) {
+            QString name;
+            in >> name;
+            model->setBinName(i, name);
+        }
+
+        in >> width;
+
+        for (int x = 0; x < width; ++x) {
+            quint32 size = 0;
+            in >> size;
+            if (in.status() != QDataStream::Ok) break;
+            DenseThreeDimensionalModel::Column column(size, 0.f);
+            for (quint32 i = 0; i < size; ++i) {
+                in >> column[i];
+            }
+            model->setColumn(x, column);
+        }
+
+        if (in.status() != QDataStream::Ok) {
+            SVDEBUG << "FeatureCache: truncated entry " << entryPath << endl;
+            return {};
+        }
+
+        model->setSourceModel(source);
+        model->setCompletion(100);
+        return model;
+    }
+
+    SVDEBUG << "FeatureCache: unknown model type " << type << " in "
+            << entryPath << endl;
+    return {};
+}
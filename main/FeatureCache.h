@@ -0,0 +1,111 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Lineup
+    Comparative visualisation and alignment of related audio recordings
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef VECT_FEATURE_CACHE_H
+#define VECT_FEATURE_CACHE_H
+
+#include <QString>
+#include <QMutex>
+
+#include <memory>
+
+#include "data/model/Model.h"
+#include "transform/Transform.h"
+
+/**
+ * Persistent store of the outputs of transforms run on session
+ * audio, kept in a "cache" directory alongside the temporary
+ * directory. An entry is keyed by the transform (identifier,
+ * parameters, plugin version and so on) together with the content
+ * hash and sample rate of the input audio.
+ *
+ * Sparse time-value and dense three-dimensional outputs are
+ * supported, which covers the pitch, key and azimuth modes. The
+ * least recently used entries are removed once the cache exceeds
+ * getSizeLimitMB().
+ */
+class QObject;
+
+class FeatureCache
+{
+public:
+    static FeatureCache *getInstance();
+
+    /**
+     * Return the cache key for running the given transform on audio
+     * with the given content hash, sample rate and normalisation, or
+     * an empty string if the hash is empty.
+     */
+    static QString makeKey(const Transform &transform,
+                           QString audioHash,
+                           sv_samplerate_t audioRate,
+                           bool normalised);
+
+    /**
+     * Store the contents of the given model, which should be
+     * complete, under the given key. The entry is written on a
+     * background thread, as dense models can be large; it appears
+     * once complete. Models of unsupported types are ignored.
+     */
+    void store(QString key, ModelId model);
+
+    /**
+     * Create, register and return a new complete model with the
+     * contents stored under the given key, derived from the given
+     * source model (so that it is aligned along with it). Return a
+     * none id if there is no usable entry. The entry is read on the
+     * calling thread; see requestRestore for large models.
+     */
+    ModelId restore(QString key, ModelId source);
+
+    /**
+     * As restore, but reading the entry on a background thread. The
+     * named slot of the receiver is then invoked through a queued
+     * call with the key, the source model, and the new model, which
+     * is a none id if there was no usable entry. The slot must take
+     * (QString, ModelId, ModelId), and becomes responsible for
+     * releasing the model if it doesn't use it.
+     */
+    void requestRestore(QString key, ModelId source,
+                        QObject *receiver, const char *slotName);
+
+    /**
+     * Return true if there is an entry stored under the given key.
+     * It may still turn out to be unusable when restored.
+     */
+    bool contains(QString key);
+
+    /**
+     * Return the maximum size of the cache in megabytes, from the
+     * "feature-cache-limit-mb" preference.
+     */
+    static int getSizeLimitMB();
+
+private:
+    FeatureCache();
+
+    class StoreTask;
+    class RestoreTask;
+    void write(QString key, ModelId model);
+    std::shared_ptr<Model> read(QString key, ModelId source);
+
+    QString getCacheDirectory();
+    QString getEntryPath(QString key);
+    void prune();
+
+    QMutex m_mutex;
+    QString m_directory;
+};
+
+#endif
@@ -0,0 +1,162 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Lineup
+    Comparative visualisation and alignment of related audio recordings
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "LayerMemoryGovernor.h"
+
+#include "layer/Layer.h"
+#include "layer/SpectrogramLayer.h"
+#include "data/model/DenseThreeDimensionalModel.h"
+#include "data/model/SparseTimeValueModel.h"
+#include "system/System.h"
+#include "base/Debug.h"
+
+#include <QSettings>
+
+#include <algorithm>
+
+LayerMemoryGovernor::LayerMemoryGovernor(QObject *parent) :
+    QObject(parent),
+    m_clock(0)
+{
+}
+
+LayerMemoryGovernor::~LayerMemoryGovernor()
+{
+}
+
+size_t
+LayerMemoryGovernor::getBudget()
+{
+    QSettings settings;
+    settings.beginGroup("Preferences");
+    int mb = settings.value("layer-memory-budget-mb", 0).toInt();
+    settings.endGroup();
+
+    if (mb <= 0) {
+        ssize_t available = 0, total = 0;
+        GetRealMemoryMBAvailable(available, total);
+        if (total > 0) {
+            mb = int(total / 4);
+        } else {
+            mb = 2048;
+        }
+    }
+
+    return size_t(mb) * 1024 * 1024;
+}
+
+size_t
+LayerMemoryGovernor::estimateFootprint(Layer *layer)
+{
+    auto modelId = layer->getModel();
+
+    if (auto sl = qobject_cast<SpectrogramLayer *>(layer)) {
+
+        // The FFT and peak caches hold about one value per bin per
+        // column of the underlying model, whatever is on screen
+        auto model = ModelById::get(modelId);
+        if (!model) return 0;
+
+        int windowSize = sl->getWindowSize();
+        int hopLevel = sl->getWindowHopLevel();
+        int increment = windowSize;
+        if (hopLevel == 1) {
+            increment = (windowSize * 3) / 4;
+        } else if (hopLevel > 1) {
+            increment = windowSize / (1 << (hopLevel - 1));
+        }
+        if (increment < 1) increment = 1;
+
+        size_t columns = size_t(model->getEndFrame() / increment) + 1;
+        size_t bins = size_t(windowSize / 2 + 1);
+        return columns * bins * sizeof(float);
+    }
+
+    if (auto dm = ModelById::getAs<DenseThreeDimensionalModel>(modelId)) {
+        return size_t(dm->getWidth()) * size_t(dm->getHeight()) *
+            sizeof(float);
+    }
+
+    if (auto sm = ModelById::getAs<SparseTimeValueModel>(modelId)) {
+        return size_t(sm->getEventCount()) * sizeof(Event);
+    }
+
+    return 0;
+}
+
+std::vector<Layer *>
+LayerMemoryGovernor::review(const std::vector<Candidate> &layers)
+{
+    ++m_clock;
+    
+    size_t total = 0;
+
+    struct Hidden {
+        Layer *layer;
+        size_t bytes;
+        qint64 lastViewed;
+    };
+    std::vector<Hidden> hidden;
+    
+    for (const auto &c: layers) {
+
+        size_t bytes = estimateFootprint(c.layer);
+        total += bytes;
+        
+        if (m_lastViewed.find(c.layer) == m_lastViewed.end()) {
+            connect(c.layer, SIGNAL(destroyed(QObject *)),
+                    this, SLOT(layerDestroyed(QObject *)));
+            m_lastViewed[c.layer] = m_clock;
+        }
+        
+        if (c.visible) {
+            m_lastViewed[c.layer] = m_clock;
+        } else if (c.evictable && bytes > 0) {
+            hidden.push_back({ c.layer, bytes, m_lastViewed[c.layer] });
+        }
+    }
+
+    size_t budget = getBudget();
+
+    SVDEBUG << "LayerMemoryGovernor::review: estimated " << total / 1048576
+            << "MB in " << layers.size() << " layers against budget of "
+            << budget / 1048576 << "MB" << endl;
+
+    std::vector<Layer *> evict;
+    if (total <= budget) {
+        return evict;
+    }
+
+    std::stable_sort(hidden.begin(), hidden.end(),
+                     [](const Hidden &a, const Hidden &b) {
+                         return a.lastViewed < b.lastViewed;
+                     });
+
+    for (const auto &h: hidden) {
+        if (total <= budget) break;
+        SVDEBUG << "LayerMemoryGovernor::review: evicting layer "
+                << h.layer << " (" << h.layer->objectName() << "), "
+                << h.bytes / 1048576 << "MB" << endl;
+        evict.push_back(h.layer);
+        total -= h.bytes;
+    }
+
+    return evict;
+}
+
+void
+LayerMemoryGovernor::layerDestroyed(QObject *layer)
+{
+    m_lastViewed.erase(layer);
+}
@@ -0,0 +1,79 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Lineup
+    Comparative visualisation and alignment of related audio recordings
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef VECT_LAYER_MEMORY_GOVERNOR_H
+#define VECT_LAYER_MEMORY_GOVERNOR_H
+
+#include <QObject>
+
+#include <map>
+#include <vector>
+
+class Layer;
+
+/**
+ * Keep the memory used by mode layers within a budget, by choosing
+ * which hidden layers should be discarded.
+ *
+ * The governor records when each layer was last on show and
+ * estimates how much memory it holds. Given the full set of mode
+ * layers, it picks the hidden ones to evict, least recently viewed
+ * first, until the estimated total is within budget. Deleting them
+ * is left to the caller, which will recreate them (from the feature
+ * cache where possible) if their mode is selected again.
+ *
+ * The budget is taken from the layer-memory-budget-mb preference if
+ * set, or is a quarter of physical memory otherwise.
+ */
+class LayerMemoryGovernor : public QObject
+{
+    Q_OBJECT
+
+public:
+    LayerMemoryGovernor(QObject *parent = 0);
+    virtual ~LayerMemoryGovernor();
+
+    struct Candidate {
+        Layer *layer;
+        bool visible;
+        bool evictable;
+    };
+
+    /**
+     * Note which of the given layers are on show now, and return
+     * those of the hidden, evictable ones that should be evicted to
+     * bring the total within budget.
+     */
+    std::vector<Layer *> review(const std::vector<Candidate> &layers);
+
+    /**
+     * Return an estimate of the memory held by the given layer and
+     * any model that is used only by it, in bytes.
+     */
+    static size_t estimateFootprint(Layer *layer);
+
+    /**
+     * Return the memory budget in bytes.
+     */
+    static size_t getBudget();
+
+protected slots:
+    void layerDestroyed(QObject *);
+
+private:
+    std::map<QObject *, qint64> m_lastViewed;
+    qint64 m_clock;
+};
+
+#endif
@@ -22,12 +22,24 @@
 #include "PreferencesDialog.h"
 #include "NetworkPermissionTester.h"
 #include "IntroDialog.h"
+#include "SessionLoader.h"
+#include "AudioCache.h"
+#include "AlignmentCache.h"
+#include "AlignmentMapping.h"
+#include "FeatureCache.h"
+#include "LayerMemoryGovernor.h"
+#include "TransformJobQueue.h"
+#include "SessionCheckpointer.h"
+#include "StartupTrace.h"
 
 #include "view/Pane.h"
 #include "view/PaneStack.h"
 #include "data/model/WaveFileModel.h"
+#include "data/model/ReadOnlyWaveFileModel.h"
 #include "data/model/SparseOneDimensionalModel.h"
 #include "data/model/AlignmentModel.h"
+#include "data/model/Path.h"
+#include "data/model/SparseTimeValueModel.h"
 #include "data/model/SparseOneDimensionalModel.h"
 #include "base/StorageAdviser.h"
 #include "base/Exceptions.h"
@@ -64,6 +76,8 @@
 #include "data/fileio/CSVFileWriter.h"
 #include "data/fileio/BZipFileDevice.h"
 #include "data/fileio/FileSource.h"
+#include "data/fileio/AudioFileReader.h"
+#include "data/fileio/AudioFileReaderFactory.h"
 #include "base/RecentFiles.h"
 #include "transform/TransformFactory.h"
 #include "transform/ModelTransformerFactory.h"
@@ -112,13 +126,17 @@
 #include <QCheckBox>
 #include <QRegExp>
 #include <QScrollArea>
+#include <QScrollBar>
+#include <QTimer>
 #include <QCloseEvent>
 #include <QDialogButtonBox>
 #include <QTextEdit>
 #include <QFileDialog>
+#include <QProgressDialog>
 
 #include <iostream>
 #include <cstdio>
+#include <cmath>
 #include <errno.h>
 
 using std::cerr;
@@ -129,6 +147,15 @@ using std::map;
 using std::set;
 using std::pair;
 
+// Object name for the layers standing in for session files that have
+// yet to be loaded
+static const char *const placeholderLayerName = "Session Placeholder"; // not to be translated
+
+// While an alignment is in progress, the most recent part of its path
+// may still change; salient features are mapped only up to this far
+// behind the aligner's progress through the aligned audio
+static const double provisionalAlignmentMarginSec = 10.0;
+
 
 MainWindow::MainWindow(AudioMode audioMode) :
     MainWindowBase(audioMode,
@@ -152,12 +179,24 @@ MainWindow::MainWindow(AudioMode audioMode) :
     m_keyReference(new KeyReference()),
     m_versionTester(nullptr),
     m_networkPermission(false),
+    m_sessionLoader(new SessionLoader(this)),
+    m_transformJobs(new TransformJobQueue
+                    ([this](Pane *pane) { return getPanePriority(pane); },
+                     this)),
+    m_checkpointer(new SessionCheckpointer(this)),
+    m_memoryGovernor(new LayerMemoryGovernor(this)),
+    m_sessionOpening(false),
+    m_sessionLoadingMainFile(false),
+    m_sessionSkipFailedFiles(false),
+    m_sessionFilesDone(0),
     m_displayMode(OutlineWaveformMode),
     m_salientCalculating(false),
     m_salientColour(0),
     m_sessionState(NoSession),
     m_shownAlignmentError(false)
 {
+    StartupTrace::Span constructorSpan("MainWindow constructor");
+
     setWindowTitle(QApplication::applicationName());
 
     setUnifiedTitleAndToolBarOnMac(true);
@@ -218,7 +257,24 @@ MainWindow::MainWindow(AudioMode audioMode) :
     m_viewManager->setShowWorkTitle(true);
     m_viewManager->setOpportunisticEditingEnabled(false);
 
-    loadStyle();
+    connect(m_sessionLoader,
+            SIGNAL(fileReady(int, QString, FileSource *, AudioFileReader *)),
+            this,
+            SLOT(sessionFileReady(int, QString, FileSource *, AudioFileReader *)));
+    connect(m_sessionLoader, SIGNAL(fileFailed(int, QString, QString)),
+            this, SLOT(sessionFileFailed(int, QString, QString)));
+    connect(m_sessionLoader, SIGNAL(finished()),
+            this, SLOT(sessionLoadFinished()));
+
+    connect(m_checkpointer, SIGNAL(saved(QString, QString)),
+            this, SLOT(checkpointSaved(QString, QString)));
+    connect(m_checkpointer, SIGNAL(saveFailed(QString, QString)),
+            this, SLOT(checkpointFailed(QString, QString)));
+
+    {
+        StartupTrace::Span span("load style");
+        loadStyle();
+    }
     
     QFrame *mainFrame = new QFrame;
     QGridLayout *mainLayout = new QGridLayout;
@@ -232,6 +288,33 @@ MainWindow::MainWindow(AudioMode audioMode) :
 
     m_mainScroll->setWidget(m_paneStack);
 
+    m_viewportTimer = new QTimer(this);
+    m_viewportTimer->setSingleShot(true);
+    m_viewportTimer->setInterval(150);
+    connect(m_viewportTimer, SIGNAL(timeout()),
+            this, SLOT(viewportSettled()));
+    connect(m_mainScroll->verticalScrollBar(), SIGNAL(valueChanged(int)),
+            this, SLOT(viewportChanged()));
+    connect(m_mainScroll->verticalScrollBar(), SIGNAL(rangeChanged(int, int)),
+            this, SLOT(viewportChanged()));
+
+    // Layers for the display modes either side of the current one
+    // are calculated speculatively once the cores have been idle for
+    // a moment, and abandoned when they are wanted for anything else
+    m_speculationTimer = new QTimer(this);
+    m_speculationTimer->setSingleShot(true);
+    m_speculationTimer->setInterval(2000);
+    connect(m_speculationTimer, SIGNAL(timeout()),
+            this, SLOT(startSpeculativeModeLayers()));
+    connect(m_transformJobs, SIGNAL(idle()),
+            m_speculationTimer, SLOT(start()));
+    connect(m_transformJobs, SIGNAL(speculationInterrupted()),
+            this, SLOT(cancelSpeculativeModeLayers()));
+    if (m_playSource) {
+        connect(m_playSource, SIGNAL(playStatusChanged(bool)),
+                this, SLOT(playbackStatusChanged(bool)));
+    }
+
     QFrame *bottomFrame = new QFrame(mainFrame);
     bottomFrame->setObjectName("BottomFrame");
     QGridLayout *bottomLayout = new QGridLayout;
@@ -381,6 +464,8 @@ MainWindow::MainWindow(AudioMode audioMode) :
     mainLayout->addWidget(bottomFrame, 1, 0);
     mainFrame->setLayout(mainLayout);
 
+    StartupTrace::Span menuSpan("set up menus");
+
     setupMenus();
 
     statusBar()->hide();
@@ -388,8 +473,13 @@ MainWindow::MainWindow(AudioMode audioMode) :
     setIconsVisibleInMenus(false);
     finaliseMenus();
 
-    NetworkPermissionTester tester;
-    m_networkPermission = tester.havePermission();
+    menuSpan.end();
+
+    {
+        StartupTrace::Span span("test network permission");
+        NetworkPermissionTester tester;
+        m_networkPermission = tester.havePermission();
+    }
         
 //    QTimer::singleShot(500, this, SLOT(betaReleaseWarning()));
 }
@@ -1091,7 +1181,25 @@ MainWindow::newSession()
 void
 MainWindow::closeSession()
 {
+    m_sessionLoader->cancel();
+    m_sessionLoadingMainFile = false;
+    m_sessionPendingFiles.clear();
+    cancelSpeculativeModeLayers();
+    m_speculativeLayers.clear();
+    m_featureCacheKeys.clear();
+    m_transformJobs->clear();
+    m_salientCalculating = false; // its job, if queued, is gone
+    m_salientPending.clear();
+    m_sessionPlaceholderPanes.clear();
+    m_fileMetadata.clear();
+    m_sessionOpening = false;
+    closeLoadProgress();
+    m_sessionSkipFailedFiles = false;
     checkpointSession();
+
+    // The checkpoint must be on disk before the caller goes on to
+    // record a different last session, or exits
+    m_checkpointer->flush();
     if (m_sessionState != SessionLoading) {
         m_sessionFile = "";
         m_sessionState = NoSession;
@@ -1250,6 +1358,8 @@ MainWindow::openRecentSession()
 bool
 MainWindow::reopenLastSession()
 {
+    StartupTrace::Span span("reopen last session");
+
     QSettings settings;
     settings.beginGroup("MainWindow");
     QString lastSession = settings.value("lastsession", "").toString();
@@ -1293,47 +1403,508 @@ MainWindow::openSmallSessionFile(QString path)
 void
 MainWindow::openSmallSession(const SmallSession &session)
 {
-    QString errorText;
-    FileOpenStatus status;
-    
     closeSession();
     createDocument();
 
-    status = openPath(session.mainFile, ReplaceMainModel);
+    // All files, including the main one, are decoded by the session
+    // loader, which may find them already in the audio cache. The
+    // main file is loaded on its own first, as its sample rate
+    // determines the rate the others will be resampled to; the rest
+    // are then decoded in parallel and handed to sessionFileReady in
+    // session order as each one becomes available
+    
+    m_sessionOpening = true;
+    m_sessionLoadingMainFile = true;
+    m_sessionPendingFiles = session.additionalFiles;
+
+    // If the session recorded enough about its files, lay out the
+    // panes now so the user can see its shape while it loads
+    createPlaceholderPanes(session);
 
-    if (status != FileOpenSucceeded) {
-        errorText = tr("Unable to open main audio file %1")
-            .arg(session.mainFile);
-        goto failed;
+    m_sessionLoader->load({ session.mainFile }, 0);
+}
+
+bool
+MainWindow::openDirectory(QString dirPath)
+{
+    QDir dir(dirPath);
+    QStringList filters = AudioFileReaderFactory::getKnownExtensions()
+        .split(" ", QString::SkipEmptyParts);
+    QStringList names = dir.entryList(filters, QDir::Files | QDir::Readable,
+                                      QDir::Name | QDir::IgnoreCase);
+
+    if (names.empty()) {
+        return false;
+    }
+
+    vector<QString> paths;
+    for (const auto &name: names) {
+        paths.push_back(dir.filePath(name));
     }
+
+    SVDEBUG << "MainWindow::openDirectory: opening " << paths.size()
+            << " audio file(s) from " << dirPath << endl;
+
+    openFileList(paths);
+    return true;
+}
+
+void
+MainWindow::openFileList(const vector<QString> &paths)
+{
+    if (paths.empty()) return;
     
-    configureNewPane(m_paneStack->getCurrentPane());
-        
-    for (QString path: session.additionalFiles) {
+    // The files are fetched and decoded in parallel by the session
+    // loader and handed to sessionFileReady in the given order, so
+    // panes appear one by one as the files become available. Files
+    // that fail are noted and skipped rather than abandoning the rest
 
-        QApplication::processEvents(QEventLoop::ExcludeUserInputEvents);
+    if (m_sessionLoadingMainFile || m_sessionLoader->isLoading()) {
+
+        // Join the load in progress: starting another would cancel
+        // it, losing whatever it had still to deliver
         
-        status = openPath(path, CreateAdditionalModel);
+        SVDEBUG << "MainWindow::openFileList: adding " << paths.size()
+                << " file(s) to the load in progress" << endl;
+
+        if (m_sessionLoadingMainFile) {
+            // These will be loaded with the rest of the session, at
+            // the rate its main file determines
+            m_sessionPendingFiles.insert(m_sessionPendingFiles.end(),
+                                         paths.begin(), paths.end());
+        } else {
+            m_sessionLoader->append(paths, 0);
+        }
 
-        if (status != FileOpenSucceeded) {
-            errorText = tr("Unable to open audio file %1").arg(path);
-            goto failed;
+        m_sessionSkipFailedFiles = true;
+
+        if (m_loadProgress) {
+            m_loadProgress->setMaximum
+                (m_loadProgress->maximum() + int(paths.size()));
+        }
+        return;
+    }
+
+    if (!getMainModel()) {
+        SmallSession session;
+        session.mainFile = paths[0];
+        session.additionalFiles = vector<QString>(paths.begin() + 1,
+                                                  paths.end());
+        openSmallSession(session);
+    } else {
+        sv_samplerate_t targetRate = 0;
+        if (Preferences::getInstance()->getResampleOnLoad()) {
+            targetRate = getMainModel()->getSampleRate();
         }
+        // Any dialog from a previous load must go, reporting what
+        // failed in it, before we make a new one
+        finishLoadProgress();
+        m_sessionLoadingMainFile = false;
+        m_sessionPendingFiles.clear();
+        m_sessionPlaceholderPanes.clear();
+        m_sessionLoader->load(paths, targetRate);
+    }
 
-        configureNewPane(m_paneStack->getCurrentPane());
+    m_sessionSkipFailedFiles = true;
+    m_sessionFailedFiles.clear();
+    m_sessionFilesDone = 0;
+
+    m_loadProgress = new QProgressDialog
+        (tr("Opening %n audio file(s)...", "", int(paths.size())),
+         tr("Cancel"), 0, int(paths.size()), this);
+    m_loadProgress->setWindowTitle(tr("Opening Audio Files"));
+    m_loadProgress->setMinimumDuration(500);
+    m_loadProgress->setAutoClose(false);
+    m_loadProgress->setAutoReset(false);
+    m_loadProgress->setValue(0);
+    connect(m_loadProgress, SIGNAL(canceled()),
+            this, SLOT(loadProgressCancelled()));
+}
+
+void
+MainWindow::updateLoadProgress()
+{
+    if (!m_loadProgress) return;
+
+    ++m_sessionFilesDone;
+    m_loadProgress->setValue(m_sessionFilesDone);
+
+    if (m_sessionFailedFiles.empty()) {
+        m_loadProgress->setLabelText
+            (tr("Opened %1 of %2 audio files...")
+             .arg(m_sessionFilesDone).arg(m_loadProgress->maximum()));
+    } else {
+        m_loadProgress->setLabelText
+            (tr("Opened %1 of %2 audio files (%3 failed)...")
+             .arg(m_sessionFilesDone).arg(m_loadProgress->maximum())
+             .arg(m_sessionFailedFiles.size()));
+    }
+}
+
+void
+MainWindow::closeLoadProgress()
+{
+    if (!m_loadProgress) return;
+
+    // QProgressDialog emits canceled() when closed, which must not
+    // reach loadProgressCancelled
+    disconnect(m_loadProgress, nullptr, this, nullptr);
+    m_loadProgress->close();
+    m_loadProgress->deleteLater();
+    m_loadProgress = nullptr;
+}
+
+void
+MainWindow::finishLoadProgress()
+{
+    closeLoadProgress();
+
+    if (!m_sessionFailedFiles.empty()) {
+        QStringList failed;
+        for (const auto &f: m_sessionFailedFiles) {
+            failed.push_back(QFileInfo(f).fileName());
+        }
+        QMessageBox::warning
+            (this, tr("Some files could not be opened"),
+             tr("<b>Open failed</b><p>The following audio files could not be opened:</p><p>%1</p>")
+             .arg(failed.join("<br>")));
+    }
+
+    m_sessionSkipFailedFiles = false;
+    m_sessionFailedFiles.clear();
+}
+
+void
+MainWindow::loadProgressCancelled()
+{
+    SVDEBUG << "MainWindow::loadProgressCancelled" << endl;
+
+    // Keep whatever has been opened so far
+    m_sessionLoader->cancel();
+    m_sessionPendingFiles.clear();
+    m_sessionLoadingMainFile = false;
+    sessionLoadFinished();
+}
+
+void
+MainWindow::sessionFileReady(int index, QString path,
+                             FileSource *source, AudioFileReader *reader)
+{
+    SVDEBUG << "MainWindow::sessionFileReady: " << path << endl;
+
+    auto model = std::make_shared<ReadOnlyWaveFileModel>(*source, reader);
+    delete source;
+
+    ModelId modelId = ModelById::add(model);
+    m_sessionLoader->trackModel(modelId);
+
+    AudioFileOpenMode mode = CreateAdditionalModel;
+    if (m_sessionLoadingMainFile) {
+        mode = ReplaceMainModel;
     }
 
-    rewindStart();
+    // If we laid out a placeholder pane for this file, its real
+    // data goes into that pane rather than a new one
+    Pane *placeholderPane = nullptr;
+    int placeholderIndex = (m_sessionLoadingMainFile ? 0 : index + 1);
+    if (in_range_for(m_sessionPlaceholderPanes, placeholderIndex)) {
+        placeholderPane = m_sessionPlaceholderPanes[placeholderIndex];
+        m_sessionPlaceholderPanes[placeholderIndex] = nullptr;
+    }
+    if (placeholderPane) {
+        m_paneStack->setCurrentPane(placeholderPane);
+        if (mode == CreateAdditionalModel) {
+            mode = ReplaceCurrentPane;
+        }
+    }
+
+    // If we have aligned this pair before, attach the cached
+    // alignment now, before the document sees the model, so that it
+    // doesn't start the aligner for it
+    bool haveCachedAlignment = false;
+    if (mode != ReplaceMainModel) {
+        haveCachedAlignment = restoreCachedAlignment(modelId);
+    }
     
-    m_documentModified = false;
-    m_sessionState = SessionActive;
-    return;
+    FileOpenStatus status = addOpenedAudioModel(path, modelId, mode, "", true);
+
+    updateLoadProgress();
+
+    if (status != FileOpenSucceeded && m_sessionSkipFailedFiles &&
+        !m_sessionLoadingMainFile) {
+        m_sessionFailedFiles.push_back(path);
+        return;
+    }
+
+    if (status != FileOpenSucceeded) {
+        m_sessionLoader->cancel();
+        if (m_sessionLoadingMainFile) {
+            sessionLoadFailed(tr("Unable to open main audio file %1")
+                              .arg(path));
+        } else {
+            sessionLoadFailed(tr("Unable to open audio file %1").arg(path));
+        }
+        return;
+    }
+
+    if (placeholderPane) {
+        removePlaceholderLayers(placeholderPane);
+    }
+    
+    configureNewPane(m_paneStack->getCurrentPane());
+
+    if (haveCachedAlignment) {
+        mapSalientFeatureLayer(modelId);
+    }
+}
+
+void
+MainWindow::sessionFileFailed(int, QString path, QString error)
+{
+    SVCERR << "MainWindow::sessionFileFailed: " << path << ": "
+           << error << endl;
+
+    if (m_sessionSkipFailedFiles) {
+        // Carry on with the rest; sessionLoadFinished will try the
+        // next file instead if this was to have been the main one
+        m_sessionFailedFiles.push_back(path);
+        updateLoadProgress();
+        return;
+    }
+    
+    m_sessionLoader->cancel();
+    if (m_sessionLoadingMainFile) {
+        sessionLoadFailed(tr("Unable to open main audio file %1").arg(path));
+    } else {
+        sessionLoadFailed(tr("Unable to open audio file %1").arg(path));
+    }
+}
+
+void
+MainWindow::sessionLoadFinished()
+{
+    if (m_sessionLoadingMainFile) {
+
+        if (!getMainModel() && m_sessionSkipFailedFiles &&
+            !m_sessionPendingFiles.empty()) {
+            // The placeholders were laid out with the failed file
+            // first, so they no longer match the files to come
+            removePlaceholderPanes();
+            QString next = m_sessionPendingFiles[0];
+            m_sessionPendingFiles.erase(m_sessionPendingFiles.begin());
+            m_sessionLoader->load({ next }, 0);
+            return;
+        }
+
+        m_sessionLoadingMainFile = false;
+
+        StartupTrace::instant("session main file loaded");
+        
+        sv_samplerate_t targetRate = 0;
+        if (Preferences::getInstance()->getResampleOnLoad() &&
+            getMainModel()) {
+            targetRate = getMainModel()->getSampleRate();
+        }
+
+        std::vector<QString> files;
+        files.swap(m_sessionPendingFiles);
+        m_sessionLoader->load(files, targetRate);
+        return;
+    }
+    
+    // Files added to a session that was already open leave it
+    // modified and where it was; only a newly opened one starts
+    // clean and from the top
+    if (m_sessionOpening) {
+        rewindStart();
+        m_documentModified = false;
+        m_sessionOpening = false;
+    }
+    m_sessionState = getMainModel() ? SessionActive : NoSession;
+
+    finishLoadProgress();
 
-failed:
+    StartupTrace::instant("session loaded");
+    StartupTrace::write();
+}
+
+void
+MainWindow::sessionLoadFailed(QString errorText)
+{
     QMessageBox::critical(this, tr("Failed to load session"),
                           tr("<b>Open failed</b><p>Session could not be opened: %2</p>").arg(errorText));
     m_sessionFile = "";
     m_sessionState = NoSession;
+    finishLoadProgress();
+}
+
+void
+MainWindow::createPlaceholderPanes(const SmallSession &session)
+{
+    m_sessionPlaceholderPanes.clear();
+
+    // Placeholders for only some of the files would leave the panes
+    // in the wrong order once the rest were added, so it's all or
+    // nothing
+    if (!session.hasCompleteMetadata()) {
+        SVDEBUG << "MainWindow::createPlaceholderPanes: session lacks "
+                << "complete file metadata, not creating placeholders"
+                << endl;
+        return;
+    }
+
+    vector<QString> files { session.mainFile };
+    files.insert(files.end(), session.additionalFiles.begin(),
+                 session.additionalFiles.end());
+
+    for (int i = 0; in_range_for(files, i); ++i) {
+
+        // We're called on a freshly closed session, so there are no
+        // panes yet, not even the main one: mainModelChanged will
+        // find the first placeholder and fill it in
+        Pane *pane = m_paneStack->addPane();
+        if (!pane) break;
+        connect(pane, SIGNAL(contextHelpChanged(const QString &)),
+                this, SLOT(contextHelpChanged(const QString &)));
+        
+        const auto &md = session.metadata.at(files[i]);
+
+        // Show the recorded summary as stems, one per summary bucket
+        // across the duration of the file
+        
+        int buckets = int(md.summary.size());
+        int resolution = int(md.frames / std::max(buckets, 1));
+        if (resolution < 1) resolution = 1;
+        
+        auto model = std::make_shared<SparseTimeValueModel>
+            (md.sampleRate, resolution, false);
+        for (int j = 0; j < buckets; ++j) {
+            model->add(Event(sv_frame_t(j) * resolution,
+                             float(md.summary[j]) / 255.f, QString()));
+        }
+        model->add(Event(md.frames, 0.f, QString()));
+
+        Layer *layer = m_document->createImportedLayer(ModelById::add(model));
+        if (!layer) break;
+
+        layer->setObjectName(placeholderLayerName);
+        LayerFactory::getInstance()->setLayerProperties
+            (layer, QString("<layer plotStyle=\"%1\" verticalScale=\"%2\"/>")
+             .arg(int(TimeValueLayer::PlotStems))
+             .arg(int(TimeValueLayer::LinearScale)));
+
+        SingleColourLayer *scl = qobject_cast<SingleColourLayer *>(layer);
+        if (scl) {
+            scl->setBaseColour
+                (i % ColourDatabase::getInstance()->getColourCount());
+        }
+
+        auto params = layer->getPlayParameters();
+        if (params) {
+            params->setPlayAudible(false);
+        }
+
+        m_document->addLayerToView(pane, layer);
+        m_sessionPlaceholderPanes.push_back(pane);
+    }
+
+    m_paneStack->setCurrentPane(m_paneStack->getPane(0));
+    zoomToFit();
+}
+
+void
+MainWindow::removePlaceholderPanes()
+{
+    for (auto pane: m_sessionPlaceholderPanes) {
+        if (!pane) continue;
+        removePlaceholderLayers(pane);
+        if (pane->getLayerCount() == 0) {
+            m_paneStack->deletePane(pane);
+        }
+    }
+    m_sessionPlaceholderPanes.clear();
+}
+
+bool
+MainWindow::hasOnlyPlaceholderLayers(Pane *pane)
+{
+    for (int i = 0; i < pane->getLayerCount(); ++i) {
+        Layer *layer = pane->getLayer(i);
+        if (layer && layer->objectName() != placeholderLayerName) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void
+MainWindow::removePlaceholderLayers(Pane *pane)
+{
+    vector<Layer *> placeholders;
+    for (int i = 0; i < pane->getLayerCount(); ++i) {
+        Layer *layer = pane->getLayer(i);
+        if (layer && layer->objectName() == placeholderLayerName) {
+            placeholders.push_back(layer);
+        }
+    }
+    for (auto layer: placeholders) {
+        m_document->deleteLayer(layer, true); // force flag: remove from views
+    }
+}
+
+bool
+MainWindow::isPlaceholderPane(Pane *pane)
+{
+    for (const auto &p: m_sessionPlaceholderPanes) {
+        if (p == pane) return true;
+    }
+    return false;
+}
+
+SmallSession::FileMetadata
+MainWindow::getFileMetadata(ModelId modelId)
+{
+    if (m_fileMetadata.find(modelId) != m_fileMetadata.end()) {
+        return m_fileMetadata[modelId];
+    }
+
+    SmallSession::FileMetadata md;
+    
+    auto model = ModelById::getAs<WaveFileModel>(modelId);
+    if (!model || !model->isReady()) {
+        return md;
+    }
+
+    md.frames = model->getEndFrame() - model->getStartFrame();
+    md.channels = model->getChannelCount();
+    md.sampleRate = model->getSampleRate();
+    md.fingerprint = getContentHash(modelId);
+
+    // A coarse peak summary, mixing all channels
+    
+    const int buckets = 512;
+    sv_frame_t start = model->getStartFrame();
+    sv_frame_t step = md.frames / buckets;
+    if (step < 1) step = 1;
+
+    for (sv_frame_t f = 0; f < md.frames; f += step) {
+        float peak = 0.f;
+        for (int c = 0; c < md.channels; ++c) {
+            auto range = model->getSummary(c, start + f, step);
+            peak = std::max(peak, std::max(fabsf(range.min()),
+                                           fabsf(range.max())));
+        }
+        if (peak > 1.f) peak = 1.f;
+        md.summary.push_back((unsigned char)(lrintf(peak * 255.f)));
+    }
+
+    // Without its fingerprint the metadata is incomplete, so we
+    // don't keep it: the hash is on its way, and will be picked up
+    // by a later checkpoint
+    if (md.fingerprint != "") {
+        m_fileMetadata[modelId] = md;
+    }
+    return md;
 }
 
 bool
@@ -1349,9 +1920,8 @@ MainWindow::selectExistingLayerForMode(Pane *pane,
     // In the case where no such layer is found and false is returned,
     // then if the return parameter createFrom is non-null, the value
     // it points to will be set to a pointer to the model from which
-    // such a layer should be constructed.
-
-    ModelId modelId;
+    // such a layer should be constructed. A ghost reference layer
+    // borrowed from the first pane is shown, but doesn't count.
 
     bool have = false;
 
@@ -1361,15 +1931,16 @@ MainWindow::selectExistingLayerForMode(Pane *pane,
         if (!layer || qobject_cast<TimeInstantLayer *>(layer)) {
             continue;
         }
+        if (layer->objectName() == placeholderLayerName) {
+            continue;
+        }
 
-        modelId = layer->getModel();
-        auto sourceId = layer->getSourceModel();
-        if (!sourceId.isNone()) modelId = sourceId;
-        
         QString ln = layer->objectName();
         if (ln == modeName) {
             layer->showLayer(pane, true);
-            have = true;
+            if (isPaneOwnLayer(pane, layer)) {
+                have = true;
+            }
         } else {
             layer->showLayer(pane, false);
         }
@@ -1378,7 +1949,7 @@ MainWindow::selectExistingLayerForMode(Pane *pane,
     if (have) return true;
 
     if (createFrom) {
-        *createFrom = modelId;
+        *createFrom = getModeSourceModel(pane);
     }
     return false;
 }
@@ -1413,8 +1984,23 @@ MainWindow::addSalientFeatureLayer(Pane *pane, ModelId modelId)
     Transform transform = tf->getDefaultTransformFor
         (id, model->getSampleRate());
 
-    ModelTransformer::Input input(modelId, -1);
+    m_transformJobs->add(pane, "Salient Features", // not to be translated
+                         [=]() {
+                             return startSalientFeatureLayer
+                                 (pane, modelId, transform);
+                         });
+}
+
+Layer *
+MainWindow::startSalientFeatureLayer(Pane *pane, ModelId modelId,
+                                     Transform transform)
+{
+    if (!ModelById::get(modelId)) {
+        return nullptr;
+    }
 
+    Pane *currentPane = m_paneStack->getCurrentPane();
+    
     Layer *newLayer = m_document->createDerivedLayer(transform, modelId);
 
     if (newLayer) {
@@ -1436,6 +2022,12 @@ MainWindow::addSalientFeatureLayer(Pane *pane, ModelId modelId)
         m_document->addLayerToView(pane, newLayer);
         m_paneStack->setCurrentLayer(pane, newLayer);
     }
+
+    if (currentPane) {
+        m_paneStack->setCurrentPane(currentPane);
+    }
+
+    return newLayer;
 }
 
 void
@@ -1573,45 +2165,25 @@ MainWindow::mapSalientFeatureLayer(ModelId modelId)
         return;
     }
 
-    Pane *pane = nullptr;
-    Layer *layer = nullptr;
-    Pane *firstPane = nullptr;
-    
-    for (int i = 0; i < m_paneStack->getPaneCount(); ++i) {
-        Pane *p = m_paneStack->getPane(i);
-        if (p && !firstPane) firstPane = p;
-        for (int j = 0; j < p->getLayerCount(); ++j) {
-            Layer *l = p->getLayer(j);
-            if (!l) continue;
-            if (l->getModel() == modelId) {
-                pane = p;
-                layer = l;
-                break;
-            }
-        }
-        if (layer) break;
-    }
+    Pane *pane = findPaneForModel(modelId);
+    Pane *firstPane = m_paneStack->getPane(0);
 
-    if (!pane || !layer) {
+    if (!pane || !firstPane) {
         SVCERR << "MainWindow::mapSalientFeatureLayer: Failed to find model "
                << modelId << " in any layer" << endl;
         return;
     }
 
-    QString salientLayerName = tr("Mapped Salient Feature Layer");
-
     // Remove any existing mapped salient layer from this pane (in
-    // case we are re-aligning an existing model)
-    for (int j = 0; j < pane->getLayerCount(); ++j) {
-        Layer *l = pane->getLayer(j);
-        if (!l) continue;
-        if (l->objectName() == salientLayerName) {
-            SVDEBUG << "MainWindow::mapSalientFeatureLayer: "
-                    << "Removing existing mapped layer " << l << endl;
-            m_document->deleteLayer(l, true); // force flag: remove from views
-            break;
-        }
+    // case we are re-aligning an existing model, or replacing a
+    // layer mapped while the alignment was in progress)
+    Layer *existing = findMappedSalientLayer(pane);
+    if (existing) {
+        SVDEBUG << "MainWindow::mapSalientFeatureLayer: "
+                << "Removing existing mapped layer " << existing << endl;
+        m_document->deleteLayer(existing, true); // force flag: remove from views
     }
+    m_salientMappedTo.erase(modelId);
 
     pane->setCentreFrame(model->alignFromReference(firstPane->getCentreFrame()));
 
@@ -1623,38 +2195,181 @@ MainWindow::mapSalientFeatureLayer(ModelId modelId)
         return;
     }
 
+    bool align = (Align::getAlignmentPreference() != Align::NoAlignment);
+
+    if (align && model->getAlignmentCompletion() < 100) {
+        // The alignment is still being calculated: map only as far
+        // as its path is settled, and extend the layer as it
+        // progresses (see alignmentProgressed)
+        SVDEBUG << "MainWindow::mapSalientFeatureLayer for model " << modelId
+                << ": alignment incomplete, mapping incrementally" << endl;
+        m_salientMappedTo[modelId] = 0;
+        extendMappedSalientFeatureLayer(modelId);
+        return;
+    }
+    
     auto to = std::make_shared<SparseOneDimensionalModel>
         (model->getSampleRate(), from->getResolution(), false);
     auto toId = ModelById::add(to);
 
-    EventVector pp = from->getAllEvents();
+    // Map all of the events in one pass. Labels are removed, as the
+    // analysis was not conducted on the audio we're mapping to
+    EventVector pp = AlignmentMapping::eventsFromReference
+        (modelId, from->getAllEvents(), align);
 
-    if (Align::getAlignmentPreference() != Align::NoAlignment) {
-        for (const auto &p: pp) {
-            Event aligned = p
-                .withFrame(model->alignFromReference(p.getFrame()))
-                .withLabel(""); // remove label, as the analysis was not
-                                // conducted on the audio we're mapping to
-            to->add(aligned);
-        }
-    } else {
-        for (const auto &p: pp) {
-            to->add(p.withLabel(""));
-        }
+    // The mapped events are in order, so each add is an append, and
+    // the model was created without notify-on-add so nothing is
+    // signalled until the layer is attached
+    for (const auto &p: pp) {
+        to->add(p);
     }
 
     SVDEBUG << "MainWindow::mapSalientFeatureLayer for model " << modelId
             << ": have " << pp.size() << " events" << endl;
-    
-    Layer *newLayer = m_document->createImportedLayer(toId);
 
-    if (newLayer) {
+    addMappedSalientLayer(pane, toId);
+}
 
-        newLayer->setObjectName(salientLayerName);
-        
-        TimeInstantLayer *til = qobject_cast<TimeInstantLayer *>(newLayer);
-        if (til) {
-            til->setPlotStyle(TimeInstantLayer::PlotInstants);
+void
+MainWindow::extendMappedSalientFeatureLayer(ModelId modelId)
+{
+    auto itr = m_salientMappedTo.find(modelId);
+    if (itr == m_salientMappedTo.end()) {
+        return;
+    }
+    
+    auto model = ModelById::get(modelId);
+    TimeInstantLayer *salient = findSalientFeatureLayer();
+    Pane *pane = findPaneForModel(modelId);
+    if (!model || !salient || !pane) {
+        return;
+    }
+
+    auto from = ModelById::getAs<SparseOneDimensionalModel>
+        (salient->getModel());
+    if (!from) {
+        return;
+    }
+
+    // Find how far into the reference the alignment path can be
+    // trusted. The aligner's reported progress is no guide to this,
+    // as MATCH reads all of its input before it emits any of its
+    // path, and mapping through a path that isn't there yet gives
+    // nonsense that we would then be stuck with. So we go by the
+    // reference frame reached by the path the alignment model
+    // actually has, less a margin for its end to settle.
+    //
+    // Note that MATCH, the default aligner, only publishes its path
+    // once it has finished, so with MATCH there is normally no path
+    // here until alignmentComplete is about to replace the lot, and
+    // this maps nothing. It pays off only for an aligner that sets
+    // a partial path as it goes
+
+    auto alignment = ModelById::getAs<AlignmentModel>(model->getAlignment());
+    const Path *path = (alignment ? alignment->getPath() : nullptr);
+    if (!path || path->getPoints().empty()) {
+        return;
+    }
+
+    sv_frame_t mappedTo = itr->second;
+    sv_frame_t settled = path->getPoints().rbegin()->mapframe -
+        sv_frame_t(provisionalAlignmentMarginSec * from->getSampleRate());
+    if (settled <= mappedTo) {
+        return;
+    }
+
+    std::shared_ptr<SparseOneDimensionalModel> to;
+    Layer *mapped = findMappedSalientLayer(pane);
+    if (mapped) {
+        to = ModelById::getAs<SparseOneDimensionalModel>(mapped->getModel());
+    }
+
+    if (!to) {
+        // This model notifies on every add, as its layer is on show
+        // while events continue to be appended to it
+        to = std::make_shared<SparseOneDimensionalModel>
+            (model->getSampleRate(), from->getResolution(), true);
+        if (!addMappedSalientLayer(pane, ModelById::add(to))) {
+            return;
+        }
+    }
+
+    EventVector pp = AlignmentMapping::eventsFromReference
+        (modelId, from->getEventsWithin(mappedTo, settled - mappedTo), true);
+    
+    for (const auto &p: pp) {
+        to->add(p);
+    }
+
+    SVDEBUG << "MainWindow::extendMappedSalientFeatureLayer for model "
+            << modelId << ": mapped " << pp.size() << " events up to "
+            << "reference frame " << settled << endl;
+
+    itr->second = settled;
+}
+
+void
+MainWindow::alignmentProgressed(ModelId modelId)
+{
+    auto model = ModelById::get(modelId);
+    if (!model || !findSalientFeatureLayer()) {
+        return;
+    }
+
+    // Completion is handled by alignmentComplete, which replaces
+    // anything mapped so far with a mapping of the whole layer
+    if (model->getAlignmentCompletion() >= 100) {
+        return;
+    }
+
+    if (m_salientMappedTo.find(modelId) == m_salientMappedTo.end()) {
+        mapSalientFeatureLayer(modelId);
+    } else {
+        extendMappedSalientFeatureLayer(modelId);
+    }
+}
+
+Pane *
+MainWindow::findPaneForModel(ModelId modelId)
+{
+    for (int i = 0; i < m_paneStack->getPaneCount(); ++i) {
+        Pane *p = m_paneStack->getPane(i);
+        for (int j = 0; j < p->getLayerCount(); ++j) {
+            Layer *l = p->getLayer(j);
+            if (l && l->getModel() == modelId) {
+                return p;
+            }
+        }
+    }
+    return nullptr;
+}
+
+Layer *
+MainWindow::findMappedSalientLayer(Pane *pane)
+{
+    QString salientLayerName = tr("Mapped Salient Feature Layer");
+
+    for (int j = 0; j < pane->getLayerCount(); ++j) {
+        Layer *l = pane->getLayer(j);
+        if (l && l->objectName() == salientLayerName) {
+            return l;
+        }
+    }
+    return nullptr;
+}
+
+Layer *
+MainWindow::addMappedSalientLayer(Pane *pane, ModelId mappedModelId)
+{
+    Layer *newLayer = m_document->createImportedLayer(mappedModelId);
+
+    if (newLayer) {
+
+        newLayer->setObjectName(tr("Mapped Salient Feature Layer"));
+        
+        TimeInstantLayer *til = qobject_cast<TimeInstantLayer *>(newLayer);
+        if (til) {
+            til->setPlotStyle(TimeInstantLayer::PlotInstants);
             til->setBaseColour(m_salientColour);
         }
         
@@ -1666,11 +2381,15 @@ MainWindow::mapSalientFeatureLayer(ModelId modelId)
         m_document->addLayerToView(pane, newLayer);
         m_paneStack->setCurrentLayer(pane, newLayer);
     }
+
+    return newLayer;
 }
 
 void
 MainWindow::outlineWaveformModeSelected()
 {
+    cancelSpeculativeModeLayers();
+
     QString name = m_modeLayerNames[OutlineWaveformMode];
 
     Pane *currentPane = m_paneStack->getCurrentPane();
@@ -1718,11 +2437,15 @@ MainWindow::outlineWaveformModeSelected()
     
     m_displayMode = OutlineWaveformMode;
     checkpointSession();
+    enforceMemoryBudget();
+    m_speculationTimer->start();
 }
 
 void
 MainWindow::standardWaveformModeSelected()
 {
+    cancelSpeculativeModeLayers();
+
     QString name = m_modeLayerNames[WaveformMode];
 
     Pane *currentPane = m_paneStack->getCurrentPane();
@@ -1770,11 +2493,15 @@ MainWindow::standardWaveformModeSelected()
 
     m_displayMode = WaveformMode;
     checkpointSession();
+    enforceMemoryBudget();
+    m_speculationTimer->start();
 }
 
 void
 MainWindow::spectrogramModeSelected()
 {
+    cancelSpeculativeModeLayers();
+
     QString name = m_modeLayerNames[SpectrogramMode];
 
     Pane *currentPane = m_paneStack->getCurrentPane();
@@ -1786,12 +2513,9 @@ MainWindow::spectrogramModeSelected()
 
         ModelId createFrom;
         if (!selectExistingLayerForMode(pane, name, &createFrom) &&
-            !createFrom.isNone()) {
-            Layer *newLayer = m_document->createLayer(LayerFactory::Spectrogram);
-            newLayer->setObjectName(name);
-            m_document->setModel(newLayer, createFrom);
-            m_document->addLayerToView(pane, newLayer);
-            m_paneStack->setCurrentLayer(pane, newLayer);
+            !createFrom.isNone() &&
+            isPaneNearViewport(pane)) {
+            addSpectrogramModeLayer(pane, SpectrogramMode, createFrom);
         }
 
         TimeInstantLayer *salient = findSalientFeatureLayer(pane);
@@ -1806,11 +2530,15 @@ MainWindow::spectrogramModeSelected()
 
     m_displayMode = SpectrogramMode;
     checkpointSession();
+    enforceMemoryBudget();
+    m_speculationTimer->start();
 }
 
 void
 MainWindow::melodogramModeSelected()
 {
+    cancelSpeculativeModeLayers();
+
     QString name = m_modeLayerNames[MelodogramMode];
 
     Pane *currentPane = m_paneStack->getCurrentPane();
@@ -1822,16 +2550,9 @@ MainWindow::melodogramModeSelected()
 
         ModelId createFrom;
         if (!selectExistingLayerForMode(pane, name, &createFrom) &&
-            !createFrom.isNone()) {
-            Layer *newLayer = m_document->createLayer
-                (LayerFactory::MelodicRangeSpectrogram);
-            SpectrogramLayer *spectrogram = qobject_cast<SpectrogramLayer *>
-                (newLayer);
-            spectrogram->setVerticallyFixed();
-            newLayer->setObjectName(name);
-            m_document->setModel(newLayer, createFrom);
-            m_document->addLayerToView(pane, newLayer);
-            m_paneStack->setCurrentLayer(pane, newLayer);
+            !createFrom.isNone() &&
+            isPaneNearViewport(pane)) {
+            addSpectrogramModeLayer(pane, MelodogramMode, createFrom);
         }
 
         TimeInstantLayer *salient = findSalientFeatureLayer(pane);
@@ -1846,17 +2567,109 @@ MainWindow::melodogramModeSelected()
 
     m_displayMode = MelodogramMode;
     checkpointSession();
+    enforceMemoryBudget();
+    m_speculationTimer->start();
 }
 
 void
-MainWindow::selectTransformDrivenMode(DisplayMode mode,
-                                      QString transformId,
-                                      Transform::ParameterMap parameters,
-                                      QString layerPropertyXml,
-                                      bool includeGhostReference)
+MainWindow::addSpectrogramModeLayer(Pane *pane, DisplayMode mode,
+                                    ModelId createFrom)
 {
+    Layer *newLayer = nullptr;
+
+    if (mode == MelodogramMode) {
+        newLayer = m_document->createLayer
+            (LayerFactory::MelodicRangeSpectrogram);
+        SpectrogramLayer *spectrogram = qobject_cast<SpectrogramLayer *>
+            (newLayer);
+        spectrogram->setVerticallyFixed();
+    } else {
+        newLayer = m_document->createLayer(LayerFactory::Spectrogram);
+    }
+    
+    newLayer->setObjectName(m_modeLayerNames[mode]);
+    m_document->setModel(newLayer, createFrom);
+    m_document->addLayerToView(pane, newLayer);
+    m_paneStack->setCurrentLayer(pane, newLayer);
+}
+
+bool
+MainWindow::getTransformDrivenMode(DisplayMode mode, TransformDrivenMode &spec)
+{
+    switch (mode) {
+
+    case PitchMode:
+        spec.transformId = "vamp:pyin:pyin:smoothedpitchtrack";
+        spec.layerPropertyXml =
+            QString("<layer plotStyle=\"%1\" verticalScale=\"%2\" scaleMinimum=\"%3\" scaleMaximum=\"%4\"/>")
+            .arg(int(TimeValueLayer::PlotDiscreteCurves))
+            .arg(int(TimeValueLayer::LogScale))
+            .arg(40)
+            .arg(510);
+        spec.includeGhostReference = true;
+        return true;
+
+    case KeyMode:
+        spec.transformId =
+            "vamp:qm-vamp-plugins:qm-keydetector:mergedkeystrength";
+        spec.layerPropertyXml =
+            QString("<layer colourMap=\"Sunset\" opaque=\"true\" smooth=\"false\" "
+                    "binScale=\"%1\" columnNormalization=\"none\"/>")
+            .arg(int(BinScale::Linear));
+        spec.includeGhostReference = false;
+        return true;
+
+    case AzimuthMode:
+        spec.transformId = "vamp:azi:azi:plan";
+        spec.layerPropertyXml =
+            QString("<layer colourMap=\"Ice\" opaque=\"true\" smooth=\"true\" "
+                    "binScale=\"%1\" columnNormalization=\"hybrid\"/>")
+            .arg(int(BinScale::Linear));
+        spec.includeGhostReference = false;
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+void
+MainWindow::selectTransformDrivenMode(DisplayMode mode)
+{
+    TransformDrivenMode spec;
+    if (!getTransformDrivenMode(mode, spec)) {
+        return;
+    }
+
+    QString transformId = spec.transformId;
+    Transform::ParameterMap parameters = spec.parameters;
+    QString layerPropertyXml = spec.layerPropertyXml;
+    bool includeGhostReference = spec.includeGhostReference;
+    
     QString name = m_modeLayerNames[mode];
 
+    // Take up any layers for this mode that have been calculated, or
+    // are still being calculated, speculatively. Then abandon the
+    // rest of the speculative work, as the cores are wanted now
+
+    set<Pane *> adopted;
+    
+    for (int i = 0; i < m_paneStack->getPaneCount(); ++i) {
+        Pane *pane = m_paneStack->getPane(i);
+        auto itr = m_speculativeLayers.find({ pane, name });
+        if (itr == m_speculativeLayers.end()) continue;
+        Layer *layer = itr->second;
+        m_speculativeLayers.erase(itr);
+        if (!layer || paneHasModeLayer(pane, name)) continue;
+        SVDEBUG << "MainWindow::selectTransformDrivenMode: using "
+                << "speculatively calculated layer for pane " << i << endl;
+        m_transformJobs->promote(layer);
+        installModeLayer(pane, i, layer, name, layerPropertyXml);
+        adopted.insert(pane);
+    }
+
+    cancelSpeculativeModeLayers();
+
     // Bring forth any existing layers of the appropriate name; for
     // each pane that lacks one, make a note of the model from which
     // we should create it
@@ -1867,7 +2680,7 @@ MainWindow::selectTransformDrivenMode(DisplayMode mode,
         Pane *pane = m_paneStack->getPane(i);
         ModelId createFrom;
         if (!selectExistingLayerForMode(pane, name, &createFrom)) {
-            if (!createFrom.isNone()) {
+            if (!createFrom.isNone() && isPaneNearViewport(pane)) {
                 sourceModels[pane] = createFrom;
             }
         }
@@ -1875,7 +2688,7 @@ MainWindow::selectTransformDrivenMode(DisplayMode mode,
 
     Layer *ghostReference = nullptr;
 
-    if (includeGhostReference && !sourceModels.empty()) {
+    if (includeGhostReference && (!sourceModels.empty() || !adopted.empty())) {
 
         // Look up the layer of this type in the first pane -- this is
         // the reference that we must include as a ghost in the pane
@@ -1903,124 +2716,608 @@ MainWindow::selectTransformDrivenMode(DisplayMode mode,
 
     TransformFactory *tf = TransformFactory::getInstance();
 
+    // Anything still queued from a previous mode is no longer
+    // wanted, but the salient feature layers are needed whatever the
+    // mode, and we are still waiting on them if they are queued
+    m_transformJobs->clearExcept("Salient Features");
+
     if (tf->haveTransform(transformId)) {
 
         for (int i = 0; i < m_paneStack->getPaneCount(); ++i) {
 
             Pane *pane = m_paneStack->getPane(i);
-
-            if (sourceModels.find(pane) == sourceModels.end()) {
-                // no need to create, this one exists already
+
+            if (sourceModels.find(pane) == sourceModels.end()) {
+                // no need to create, this one exists already
+                continue;
+            }
+
+            ModelId source = sourceModels[pane];
+
+            if (ghostReference && !paneContainsLayer(pane, ghostReference)) {
+                m_document->addLayerToView(pane, ghostReference);
+                pane->setUseAligningProxy(true);
+            }
+            
+            Transform transform = tf->getDefaultTransformFor(transformId);
+
+            if (!parameters.empty()) {
+                transform.setParameters(parameters);
+            }
+
+            if (isRestoringModeLayer(pane, mode)) {
+                continue;
+            }
+            
+            // The reference pane's layer has to exist before the
+            // others can use it as a ghost, so that one can't wait
+            // in the queue or on the cache. (It is only ever a
+            // sparse pitch track, so is quick to read.) The rest are
+            // read from the cache in the background where possible,
+            // and queued for calculation otherwise
+
+            bool isGhostReference =
+                (!ghostReference && includeGhostReference && i == 0);
+
+            Layer *layer = nullptr;
+            
+            if (isGhostReference) {
+                layer = restoreModeLayer(transform, source);
+                if (!layer) {
+                    layer = createModeLayer(transform, source);
+                }
+                if (!layer) {
+                    SVCERR << "ERROR: Failed to create derived layer" << endl;
+                }
+            }
+            
+            if (layer) {
+                installModeLayer(pane, i, layer, name, layerPropertyXml);
+                if (isGhostReference) {
+                    ghostReference = layer;
+                }
+            } else if (!requestModeLayerRestore(pane, i, mode, transform,
+                                                source, layerPropertyXml)) {
+                queueModeLayer(pane, i, mode, transform, source,
+                               layerPropertyXml);
+            }
+        }
+    } else {
+        SVCERR << "ERROR: No plugin available for mode: " << name << endl;
+    }
+
+    if (ghostReference) {
+        for (Pane *pane: adopted) {
+            if (pane == m_paneStack->getPane(0)) continue;
+            if (paneContainsLayer(pane, ghostReference)) continue;
+            m_document->addLayerToView(pane, ghostReference);
+            pane->setUseAligningProxy(true);
+        }
+    }
+
+    if (currentPane) {
+        m_paneStack->setCurrentPane(currentPane);
+    }
+
+    m_displayMode = mode;
+    checkpointSession();
+    enforceMemoryBudget();
+    m_speculationTimer->start();
+}
+
+QString
+MainWindow::getFeatureCacheKey(const Transform &transform, ModelId source)
+{
+    auto sourceModel = ModelById::get(source);
+    if (!sourceModel) return {};
+    
+    return FeatureCache::makeKey
+        (transform,
+         getContentHash(source),
+         sourceModel->getSampleRate(),
+         Preferences::getInstance()->getNormaliseAudio());
+}
+
+Layer *
+MainWindow::restoreModeLayer(const Transform &transform, ModelId source)
+{
+    QString key = getFeatureCacheKey(transform, source);
+    if (key == "") return nullptr;
+
+    ModelId cached = FeatureCache::getInstance()->restore(key, source);
+    if (cached.isNone()) return nullptr;
+
+    SVDEBUG << "MainWindow::restoreModeLayer: Using cached output of "
+            << transform.getIdentifier() << " for model "
+            << source << endl;
+    return m_document->createImportedLayer(cached);
+}
+
+bool
+MainWindow::requestModeLayerRestore(Pane *pane, int paneIndex,
+                                    DisplayMode mode, Transform transform,
+                                    ModelId source, QString layerPropertyXml)
+{
+    QString key = getFeatureCacheKey(transform, source);
+    if (key == "" || !FeatureCache::getInstance()->contains(key)) {
+        return false;
+    }
+
+    PendingRestore pending;
+    pending.pane = pane;
+    pending.paneIndex = paneIndex;
+    pending.mode = mode;
+    pending.transform = transform;
+    pending.source = source;
+    pending.layerPropertyXml = layerPropertyXml;
+    m_pendingRestores.insert({ key, pending });
+
+    FeatureCache::getInstance()->requestRestore
+        (key, source, this, "modeLayerRestored");
+    return true;
+}
+
+bool
+MainWindow::isRestoringModeLayer(Pane *pane, DisplayMode mode)
+{
+    for (const auto &p: m_pendingRestores) {
+        if (p.second.pane == pane && p.second.mode == mode) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void
+MainWindow::modeLayerRestored(QString key, ModelId source, ModelId modelId)
+{
+    vector<PendingRestore> pending;
+    auto range = m_pendingRestores.equal_range(key);
+    for (auto itr = range.first; itr != range.second; ++itr) {
+        if (itr->second.source == source) {
+            pending.push_back(itr->second);
+        }
+    }
+    for (auto itr = range.first; itr != range.second; ) {
+        if (itr->second.source == source) {
+            itr = m_pendingRestores.erase(itr);
+        } else {
+            ++itr;
+        }
+    }
+
+    Pane *currentPane = m_paneStack->getCurrentPane();
+
+    bool usable = !modelId.isNone();
+    
+    for (const auto &p: pending) {
+
+        // As with queued layers, the user may have moved on
+        Pane *pane = p.pane;
+        QString name = m_modeLayerNames[p.mode];
+        if (!pane || m_displayMode != p.mode ||
+            paneHasModeLayer(pane, name) || !ModelById::get(p.source)) {
+            continue;
+        }
+
+        if (!usable) {
+            queueModeLayer(pane, p.paneIndex, p.mode, p.transform,
+                           p.source, p.layerPropertyXml);
+            continue;
+        }
+
+        if (modelId.isNone()) {
+            // Each model can only go into one layer. Panes sharing a
+            // source are rare enough that the others can just read
+            // the entry again
+            if (!requestModeLayerRestore(pane, p.paneIndex, p.mode,
+                                         p.transform, p.source,
+                                         p.layerPropertyXml)) {
+                queueModeLayer(pane, p.paneIndex, p.mode, p.transform,
+                               p.source, p.layerPropertyXml);
+            }
+            continue;
+        }
+
+        SVDEBUG << "MainWindow::modeLayerRestored: Using cached output of "
+                << p.transform.getIdentifier() << " for model "
+                << p.source << endl;
+        
+        Layer *layer = m_document->createImportedLayer(modelId);
+        modelId = {};
+        
+        if (layer) {
+            installModeLayer(pane, p.paneIndex, layer, name,
+                             p.layerPropertyXml);
+        } else {
+            SVCERR << "ERROR: Failed to create layer for cached features"
+                   << endl;
+        }
+    }
+
+    if (!modelId.isNone()) {
+        ModelById::release(modelId);
+    }
+
+    if (currentPane) {
+        m_paneStack->setCurrentPane(currentPane);
+    }
+}
+
+void
+MainWindow::queueModeLayer(Pane *pane, int paneIndex, DisplayMode mode,
+                           Transform transform, ModelId source,
+                           QString layerPropertyXml)
+{
+    m_transformJobs->add
+        (pane, m_modeLayerNames[mode],
+         [=]() {
+             return startQueuedModeLayer
+                 (pane, paneIndex, mode, transform, source,
+                  layerPropertyXml);
+         });
+}
+
+Layer *
+MainWindow::createModeLayer(const Transform &transform, ModelId source)
+{
+    QString key = getFeatureCacheKey(transform, source);
+    
+    Layer *layer = m_document->createDerivedLayer(transform, source);
+
+    if (layer && key != "") {
+        m_featureCacheKeys[layer->getModel()] = key;
+        connect(layer, SIGNAL(modelCompletionChanged(ModelId)),
+                this, SLOT(modeLayerCompletionChanged(ModelId)));
+    }
+
+    return layer;
+}
+
+void
+MainWindow::installModeLayer(Pane *pane, int paneIndex, Layer *layer,
+                             QString name, QString layerPropertyXml)
+{
+    layer->setObjectName(name);
+    LayerFactory::getInstance()->setLayerProperties
+        (layer, layerPropertyXml);
+
+    SingleColourLayer *scl = qobject_cast<SingleColourLayer *>(layer);
+    if (scl) {
+        int colourIndex = 
+            (paneIndex % ColourDatabase::getInstance()->getColourCount());
+        scl->setBaseColour(colourIndex);
+    }
+
+    m_document->addLayerToView(pane, layer);
+    m_paneStack->setCurrentLayer(pane, layer);
+
+    TimeInstantLayer *salient = findSalientFeatureLayer(pane);
+    if (salient) {
+        pane->propertyContainerSelected(pane, salient);
+    }
+}
+
+Layer *
+MainWindow::startQueuedModeLayer(Pane *pane, int paneIndex,
+                                 DisplayMode mode, Transform transform,
+                                 ModelId source, QString layerPropertyXml)
+{
+    // The user may have moved on since this was queued, and we'll
+    // be asked again if they come back
+    QString name = m_modeLayerNames[mode];
+    if (m_displayMode != mode || paneHasModeLayer(pane, name) ||
+        !ModelById::get(source)) {
+        return nullptr;
+    }
+
+    Pane *currentPane = m_paneStack->getCurrentPane();
+    
+    Layer *layer = createModeLayer(transform, source);
+    
+    if (layer) {
+        installModeLayer(pane, paneIndex, layer, name, layerPropertyXml);
+    } else {
+        SVCERR << "ERROR: Failed to create derived layer" << endl;
+    }
+
+    if (currentPane) {
+        m_paneStack->setCurrentPane(currentPane);
+    }
+
+    return layer;
+}
+
+void
+MainWindow::modeLayerCompletionChanged(ModelId modelId)
+{
+    if (m_featureCacheKeys.find(modelId) == m_featureCacheKeys.end()) {
+        return;
+    }
+    
+    Layer *layer = qobject_cast<Layer *>(sender());
+    if (!layer || layer->getCompletion(0) < 100) {
+        return;
+    }
+
+    QString key = m_featureCacheKeys[modelId];
+    m_featureCacheKeys.erase(modelId);
+
+    FeatureCache::getInstance()->store(key, modelId);
+
+    // Not directly, as the budget might mean evicting the sender
+    QMetaObject::invokeMethod(this, "enforceMemoryBudget",
+                              Qt::QueuedConnection);
+}
+
+void
+MainWindow::enforceMemoryBudget()
+{
+    // The waveform modes are cheap, so only the layers for the
+    // other modes are considered
+    set<QString> names;
+    for (const auto &mp: m_modeLayerNames) {
+        if (mp.first != OutlineWaveformMode && mp.first != WaveformMode) {
+            names.insert(mp.second);
+        }
+    }
+    QString currentName = m_modeLayerNames[m_displayMode];
+    
+    map<Layer *, LayerMemoryGovernor::Candidate> candidates;
+    
+    for (int i = 0; i < m_paneStack->getPaneCount(); ++i) {
+        Pane *pane = m_paneStack->getPane(i);
+        if (!pane) continue;
+        for (int j = 0; j < pane->getLayerCount(); ++j) {
+            Layer *layer = pane->getLayer(j);
+            if (!layer || names.find(layer->objectName()) == names.end()) {
+                continue;
+            }
+            // Layers in the first pane may be used as ghost
+            // references in the others, so are never evicted; nor
+            // is anything still calculating, or in the current mode
+            bool evictable = (i > 0 &&
+                              layer->objectName() != currentName &&
+                              layer->getCompletion(pane) >= 100);
+            bool visible = !layer->isLayerDormant(pane);
+            auto itr = candidates.find(layer);
+            if (itr == candidates.end()) {
+                candidates[layer] = { layer, visible, evictable };
+            } else {
+                itr->second.visible = itr->second.visible || visible;
+                itr->second.evictable = itr->second.evictable && evictable;
+            }
+        }
+    }
+    
+    // Speculative layers not yet taken up are hidden too
+    for (const auto &sp: m_speculativeLayers) {
+        Layer *layer = sp.second;
+        if (!layer || candidates.find(layer) != candidates.end()) continue;
+        candidates[layer] = { layer, false, layer->getCompletion(0) >= 100 };
+    }
+
+    vector<LayerMemoryGovernor::Candidate> cv;
+    for (const auto &c: candidates) {
+        cv.push_back(c.second);
+    }
+
+    vector<Layer *> evict = m_memoryGovernor->review(cv);
+
+    for (Layer *layer: evict) {
+
+        // Take the ghost reference out of any pane this layer is
+        // leaving, so as not to leave the borrowed one standing in
+        // for it. It goes back in when the layer is recalculated
+        for (int i = 1; i < m_paneStack->getPaneCount(); ++i) {
+            Pane *pane = m_paneStack->getPane(i);
+            if (!pane || !paneContainsLayer(pane, layer)) continue;
+            vector<Layer *> ghosts;
+            for (int j = 0; j < pane->getLayerCount(); ++j) {
+                Layer *other = pane->getLayer(j);
+                if (other && other != layer &&
+                    other->objectName() == layer->objectName() &&
+                    !isPaneOwnLayer(pane, other)) {
+                    ghosts.push_back(other);
+                }
+            }
+            for (Layer *ghost: ghosts) {
+                m_document->removeLayerFromView(pane, ghost);
+            }
+        }
+        
+        for (auto itr = m_speculativeLayers.begin();
+             itr != m_speculativeLayers.end(); ++itr) {
+            if (itr->second == layer) {
+                m_speculativeLayers.erase(itr);
+                break;
+            }
+        }
+        m_featureCacheKeys.erase(layer->getModel());
+        m_document->deleteLayer(layer, true);
+    }
+}
+
+void
+MainWindow::pitchModeSelected()
+{
+    selectTransformDrivenMode(PitchMode);
+}
+
+void
+MainWindow::keyModeSelected()
+{
+    selectTransformDrivenMode(KeyMode);
+}
+
+void
+MainWindow::azimuthModeSelected()
+{
+    selectTransformDrivenMode(AzimuthMode);
+}
+
+void
+MainWindow::startSpeculativeModeLayers()
+{
+    // Only when nothing the user has asked for is calculating, and
+    // not during playback
+    if (!m_transformJobs->isIdle() ||
+        (m_playSource && m_playSource->isPlaying())) {
+        return;
+    }
+
+    vector<DisplayMode> adjacent;
+    for (int i = 0; in_range_for(m_modeDisplayOrder, i); ++i) {
+        if (m_displayMode == m_modeDisplayOrder[i]) {
+            if (in_range_for(m_modeDisplayOrder, i+1)) {
+                adjacent.push_back(m_modeDisplayOrder[i+1]);
+            }
+            if (i > 0) {
+                adjacent.push_back(m_modeDisplayOrder[i-1]);
+            }
+            break;
+        }
+    }
+
+    TransformFactory *tf = TransformFactory::getInstance();
+
+    for (DisplayMode mode: adjacent) {
+
+        // Only the transform-driven modes are worth calculating in
+        // advance; the others are calculated as they are drawn
+        TransformDrivenMode spec;
+        if (!getTransformDrivenMode(mode, spec) ||
+            !tf->haveTransform(spec.transformId)) {
+            continue;
+        }
+
+        QString name = m_modeLayerNames[mode];
+
+        for (int i = 0; i < m_paneStack->getPaneCount(); ++i) {
+
+            Pane *pane = m_paneStack->getPane(i);
+            if (!pane || !isPaneNearViewport(pane) ||
+                isPlaceholderPane(pane) || paneHasModeLayer(pane, name)) {
                 continue;
             }
 
-            ModelId source = sourceModels[pane];
-
-            if (ghostReference) {
-                m_document->addLayerToView(pane, ghostReference);
-                pane->setUseAligningProxy(true);
+            auto itr = m_speculativeLayers.find({ pane, name });
+            if (itr != m_speculativeLayers.end() && itr->second) {
+                continue;
             }
-            
-            Transform transform = tf->getDefaultTransformFor(transformId);
 
-            if (!parameters.empty()) {
-                transform.setParameters(parameters);
+            ModelId source = getModeSourceModel(pane);
+            if (source.isNone()) {
+                continue;
             }
 
-            ModelTransformer::Input input(source, -1);
-
-            Layer *layer = m_document->createDerivedLayer(transform, source);
-
-            if (layer) {
-
-                layer->setObjectName(name);
-                LayerFactory::getInstance()->setLayerProperties
-                    (layer, layerPropertyXml);
-
-                SingleColourLayer *scl =
-                    qobject_cast<SingleColourLayer *>(layer);
-                if (scl) {
-                    int colourIndex = 
-                        (i % ColourDatabase::getInstance()->getColourCount());
-                    scl->setBaseColour(colourIndex);
-                }
-
-                m_document->addLayerToView(pane, layer);
-                m_paneStack->setCurrentLayer(pane, layer);
-
-                if (!ghostReference && includeGhostReference && i == 0) {
-                    ghostReference = layer;
-                }
-                
-            } else {
-                SVCERR << "ERROR: Failed to create derived layer" << endl;
+            Transform transform = tf->getDefaultTransformFor(spec.transformId);
+            if (!spec.parameters.empty()) {
+                transform.setParameters(spec.parameters);
             }
 
-            TimeInstantLayer *salient = findSalientFeatureLayer(pane);
-            if (salient) {
-                pane->propertyContainerSelected(pane, salient);
+            // No need if it can be restored from the cache already
+            if (FeatureCache::getInstance()->contains
+                (getFeatureCacheKey(transform, source))) {
+                continue;
             }
+
+            m_transformJobs->addSpeculative
+                (pane, name,
+                 [=]() {
+                     return startSpeculativeModeLayer
+                         (pane, mode, transform, source);
+                 });
         }
-    } else {
-        SVCERR << "ERROR: No plugin available for mode: " << name << endl;
     }
+}
 
-    if (currentPane) {
-        m_paneStack->setCurrentPane(currentPane);
+Layer *
+MainWindow::startSpeculativeModeLayer(Pane *pane, DisplayMode mode,
+                                      Transform transform, ModelId source)
+{
+    QString name = m_modeLayerNames[mode];
+    if (m_displayMode == mode || paneHasModeLayer(pane, name) ||
+        !ModelById::get(source)) {
+        return nullptr;
     }
 
-    m_displayMode = mode;
-    checkpointSession();
+    auto itr = m_speculativeLayers.find({ pane, name });
+    if (itr != m_speculativeLayers.end() && itr->second) {
+        return nullptr;
+    }
+
+    // The layer is not added to any view until the user selects its
+    // mode, at which point selectTransformDrivenMode takes it up
+    Layer *layer = createModeLayer(transform, source);
+    if (layer) {
+        m_speculativeLayers[{ pane, name }] = layer;
+    }
+    return layer;
 }
 
 void
-MainWindow::pitchModeSelected()
+MainWindow::cancelSpeculativeModeLayers()
 {
-    QString propertyXml =
-        QString("<layer plotStyle=\"%1\" verticalScale=\"%2\" scaleMinimum=\"%3\" scaleMaximum=\"%4\"/>")
-        .arg(int(TimeValueLayer::PlotDiscreteCurves))
-        .arg(int(TimeValueLayer::LogScale))
-        .arg(40)
-        .arg(510);
+    m_speculationTimer->stop();
+    m_transformJobs->clearSpeculative();
+
+    // Layers that have finished are kept, as they cost nothing more
+    // to hold on to, but those still calculating are abandoned
     
-    selectTransformDrivenMode
-        (PitchMode,
-         "vamp:pyin:pyin:smoothedpitchtrack",
-         {},
-         propertyXml,
-         true); // ghost reference
+    auto itr = m_speculativeLayers.begin();
+    while (itr != m_speculativeLayers.end()) {
+        Layer *layer = itr->second;
+        if (!layer) {
+            itr = m_speculativeLayers.erase(itr);
+        } else if (layer->getCompletion(0) < 100) {
+            SVDEBUG << "MainWindow::cancelSpeculativeModeLayers: abandoning "
+                    << "incomplete layer " << layer << endl;
+            m_featureCacheKeys.erase(layer->getModel());
+            itr = m_speculativeLayers.erase(itr);
+            m_document->deleteLayer(layer, true);
+        } else {
+            ++itr;
+        }
+    }
 }
 
 void
-MainWindow::keyModeSelected()
+MainWindow::playbackStatusChanged(bool playing)
 {
-    QString propertyXml =
-        QString("<layer colourMap=\"Sunset\" opaque=\"true\" smooth=\"false\" "
-                "binScale=\"%1\" columnNormalization=\"none\"/>")
-        .arg(int(BinScale::Linear));
-    
-    selectTransformDrivenMode
-        (KeyMode,
-         "vamp:qm-vamp-plugins:qm-keydetector:mergedkeystrength",
-         {},
-         propertyXml,
-         false);
+    if (playing) {
+        cancelSpeculativeModeLayers();
+    } else {
+        m_speculationTimer->start();
+    }
 }
 
-void
-MainWindow::azimuthModeSelected()
+ModelId
+MainWindow::getModeSourceModel(Pane *pane)
 {
-    QString propertyXml =
-        QString("<layer colourMap=\"Ice\" opaque=\"true\" smooth=\"true\" "
-                "binScale=\"%1\" columnNormalization=\"hybrid\"/>")
-        .arg(int(BinScale::Linear));
+    // The pane's own audio is whatever its waveform layer shows. A
+    // derived layer here may be a ghost borrowed from the reference
+    // pane, so its source is used only if there is nothing better
+    
+    ModelId modelId;
+
+    for (int i = 0; i < pane->getLayerCount(); ++i) {
+        Layer *layer = pane->getLayer(i);
+        if (!layer || qobject_cast<TimeInstantLayer *>(layer)) {
+            continue;
+        }
+        if (layer->objectName() == placeholderLayerName) {
+            continue;
+        }
+        if (ModelById::getAs<WaveFileModel>(layer->getModel())) {
+            return layer->getModel();
+        }
+        modelId = layer->getModel();
+        auto sourceId = layer->getSourceModel();
+        if (!sourceId.isNone()) modelId = sourceId;
+    }
 
-    selectTransformDrivenMode
-        (AzimuthMode,
-         "vamp:azi:azi:plan",
-         {},
-         propertyXml,
-         false);
+    return modelId;
 }
 
 void
@@ -2110,6 +3407,176 @@ MainWindow::reselectMode()
     }
 }
 
+bool
+MainWindow::isPaneNearViewport(Pane *pane)
+{
+    if (!pane) return false;
+    if (m_paneStack->getPaneCount() > 0 && pane == m_paneStack->getPane(0)) {
+        return true;
+    }
+
+    // Anything within one screenful above or below the visible area
+    // counts as near, so that ordinary scrolling finds it ready
+
+    QRect visible = getVisiblePaneStackRect();
+    QRect near = visible.adjusted(0, -visible.height(), 0, visible.height());
+
+    QRect paneRect(pane->mapTo(m_paneStack, QPoint(0, 0)), pane->size());
+    return near.intersects(paneRect);
+}
+
+QRect
+MainWindow::getVisiblePaneStackRect()
+{
+    int top = m_mainScroll->verticalScrollBar()->value();
+    return QRect(0, top, m_paneStack->width(),
+                 m_mainScroll->viewport()->height());
+}
+
+int
+MainWindow::getPanePriority(Pane *pane)
+{
+    if (pane == m_paneStack->getCurrentPane()) {
+        return 0;
+    }
+    
+    QRect paneRect(pane->mapTo(m_paneStack, QPoint(0, 0)), pane->size());
+    if (getVisiblePaneStackRect().intersects(paneRect)) {
+        return 1;
+    }
+
+    return 2;
+}
+
+bool
+MainWindow::isPaneOwnLayer(Pane *pane, Layer *layer)
+{
+    ModelId modelId = layer->getSourceModel();
+    if (modelId.isNone()) modelId = layer->getModel();
+    return !modelId.isNone() && modelId == getModeSourceModel(pane);
+}
+
+bool
+MainWindow::paneHasModeLayer(Pane *pane, QString modeName)
+{
+    for (int i = 0; i < pane->getLayerCount(); ++i) {
+        Layer *layer = pane->getLayer(i);
+        if (!layer || qobject_cast<TimeInstantLayer *>(layer)) {
+            continue;
+        }
+        if (layer->objectName() == modeName && isPaneOwnLayer(pane, layer)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool
+MainWindow::paneContainsLayer(Pane *pane, Layer *layer)
+{
+    for (int i = 0; i < pane->getLayerCount(); ++i) {
+        if (pane->getLayer(i) == layer) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void
+MainWindow::viewportChanged()
+{
+    m_viewportTimer->start();
+}
+
+void
+MainWindow::viewportSettled()
+{
+    // Create any mode layers that were deferred for panes that have
+    // now been scrolled into or near the viewport. Only those panes
+    // are touched: reselecting the whole mode would also checkpoint
+    // the session and throw away the queued and speculative work
+    
+    QString name = m_modeLayerNames[m_displayMode];
+
+    Pane *currentPane = m_paneStack->getCurrentPane();
+    
+    for (int i = 0; i < m_paneStack->getPaneCount(); ++i) {
+        Pane *pane = m_paneStack->getPane(i);
+        if (!pane || !isPaneNearViewport(pane)) continue;
+        if (isPlaceholderPane(pane)) continue;
+        if (!paneHasModeLayer(pane, name)) {
+            SVDEBUG << "MainWindow::viewportSettled: pane " << i
+                    << " lacks layer for current mode, creating it" << endl;
+            addMissingModeLayer(pane, i);
+        }
+    }
+
+    if (currentPane) {
+        m_paneStack->setCurrentPane(currentPane);
+    }
+}
+
+void
+MainWindow::addMissingModeLayer(Pane *pane, int paneIndex)
+{
+    DisplayMode mode = m_displayMode;
+    QString name = m_modeLayerNames[mode];
+    
+    ModelId source = getModeSourceModel(pane);
+    if (source.isNone()) return;
+
+    if (mode == SpectrogramMode || mode == MelodogramMode) {
+        addSpectrogramModeLayer(pane, mode, source);
+        return;
+    }
+    
+    TransformDrivenMode spec;
+    if (!getTransformDrivenMode(mode, spec)) {
+        // The waveform modes are never deferred
+        return;
+    }
+
+    if (isRestoringModeLayer(pane, mode) ||
+        m_transformJobs->isPending(pane, name)) {
+        return;
+    }
+
+    TransformFactory *tf = TransformFactory::getInstance();
+    if (!tf->haveTransform(spec.transformId)) {
+        return;
+    }
+
+    Transform transform = tf->getDefaultTransformFor(spec.transformId);
+    if (!spec.parameters.empty()) {
+        transform.setParameters(spec.parameters);
+    }
+
+    // The reference pane is always near the viewport, so its layer
+    // exists already if this mode uses it as a ghost
+    if (spec.includeGhostReference && paneIndex > 0) {
+        Pane *first = m_paneStack->getPane(0);
+        for (int i = 0; first && i < first->getLayerCount(); ++i) {
+            Layer *layer = first->getLayer(i);
+            if (!layer || qobject_cast<TimeInstantLayer *>(layer)) {
+                continue;
+            }
+            if (layer->objectName() == name) {
+                if (!paneContainsLayer(pane, layer)) {
+                    m_document->addLayerToView(pane, layer);
+                    pane->setUseAligningProxy(true);
+                }
+                break;
+            }
+        }
+    }
+
+    if (!requestModeLayerRestore(pane, paneIndex, mode, transform,
+                                 source, spec.layerPropertyXml)) {
+        queueModeLayer(pane, paneIndex, mode, transform, source,
+                       spec.layerPropertyXml);
+    }
+}
+
 void
 MainWindow::paneAdded(Pane *pane)
 {
@@ -2146,9 +3613,7 @@ MainWindow::paneDropAccepted(Pane * /* pane */, QStringList uriList)
         first.isLocalFile() &&
         QFileInfo(first.path()).isDir()) {
 
-        FileOpenStatus status = openDirOfAudio(first.path());
-
-        if (status != FileOpenSucceeded) {
+        if (!openDirectory(first.path())) {
             QMessageBox::critical(this, tr("Failed to open dropped URL"),
                                   tr("<b>Open failed</b><p>Dropped URL \"%1\" could not be opened").arg(uriList[0]));
         }
@@ -2156,32 +3621,13 @@ MainWindow::paneDropAccepted(Pane * /* pane */, QStringList uriList)
         return;
     }
     
+    // Remote files are downloaded concurrently, and each is decoded
+    // as soon as it arrives
+    vector<QString> paths;
     for (QString uri: uriList) {
-
-        FileOpenStatus status = FileOpenFailed;
-        
-        FileSource source(uri);
-        if (source.isAvailable()) {
-            source.waitForData();
-
-            try {
-                status = openAudio(source, CreateAdditionalModel);
-            } catch (const InsufficientDiscSpace &e) {
-                SVCERR << "MainWindowBase: Caught InsufficientDiscSpace in file open" << endl;
-                QMessageBox::critical
-                    (this, tr("Not enough disc space"),
-                     tr("<b>Not enough disc space</b><p>There doesn't appear to be enough spare disc space to accommodate any necessary temporary files.</p><p>Please clear some space and try again.</p>").arg(e.what()));
-                return;
-            }
-        }
-            
-        if (status != FileOpenSucceeded) {
-            QMessageBox::critical(this, tr("Failed to open dropped URL"),
-                                  tr("<b>Open failed</b><p>Dropped audio file location \"%1\" could not be opened").arg(uri));
-        } else {
-            configureNewPane(m_paneStack->getCurrentPane());
-        }
+        paths.push_back(uri);
     }
+    openFileList(paths);
 }
 
 void
@@ -2319,6 +3765,7 @@ MainWindow::commitData(bool /* mayAskUser */)
         m_preferencesDialog->applicationClosing(true);
     }
     checkpointSession();
+    m_checkpointer->flush();
     return true;
 }
 
@@ -2411,7 +3858,30 @@ MainWindow::updateAlignmentPreferences(Align::AlignmentType alignmentType,
             subsequence == m_previousSubsequence) {
             m_document->alignModels();
         } else {
-            m_document->realignModels();
+
+            // Take any alignments we can from the cache, and clear
+            // the rest so that the document recalculates only those.
+            // Either way the superseded alignment is released
+
+            vector<ModelId> restored;
+            
+            for (auto modelId: getAdditionalAudioModels()) {
+                if (restoreCachedAlignment(modelId)) {
+                    restored.push_back(modelId);
+                } else if (auto model = ModelById::get(modelId)) {
+                    ModelId previous = model->getAlignment();
+                    model->setAlignment({});
+                    if (!previous.isNone()) {
+                        ModelById::release(previous);
+                    }
+                }
+            }
+
+            m_document->alignModels();
+
+            for (auto modelId: restored) {
+                mapSalientFeatureLayer(modelId);
+            }
         }
 
         m_document->setAutoAlignment(true);
@@ -2724,9 +4194,16 @@ MainWindow::layerInAView(Layer *layer, bool inAView)
 }
 
 void
-MainWindow::modelAdded(ModelId model)
+MainWindow::modelAdded(ModelId modelId)
 {
-    MainWindowBase::modelAdded(model);
+    MainWindowBase::modelAdded(modelId);
+
+    // Follow the progress of any alignment of this model, so that
+    // salient features can be mapped before it is complete
+    if (auto model = ModelById::getAs<WaveFileModel>(modelId)) {
+        connect(model.get(), SIGNAL(alignmentCompletionChanged(ModelId)),
+                this, SLOT(alignmentProgressed(ModelId)));
+    }
 }
 
 QString
@@ -2867,30 +4344,46 @@ MainWindow::checkpointSession()
     SVCERR << "MainWindow::checkpointSession: saving to session file: "
            << m_sessionFile << endl;
 
-    SmallSession session(makeSmallSession());
+    // The snapshot is taken now, but written in the background; the
+    // document is only marked as saved once checkpointSaved hears
+    // that the write succeeded
+    m_checkpointer->submit(makeSmallSession(), m_sessionFile,
+                           makeSessionLabel());
+}
+
+void
+MainWindow::checkpointSaved(QString file, QString label)
+{
+    // Avoid rewriting the recent sessions list if nothing about it
+    // would change, as it is common for the same session to be
+    // checkpointed many times over
+    auto recent = m_recentSessions.getRecentEntries();
+    if (recent.empty() ||
+        recent[0].first != file ||
+        recent[0].second != label) {
+        m_recentSessions.addFile(file, label);
+    }
 
-    try {
-        SmallSession::save(session, m_sessionFile);
-        m_recentSessions.addFile(m_sessionFile, makeSessionLabel());
+    // A checkpoint of a session we have since moved away from says
+    // nothing about the state of the current one
+    if (file == m_sessionFile) {
         CommandHistory::getInstance()->documentSaved();
         documentRestored();
+    }
 
-        QSettings settings;
-        settings.beginGroup("MainWindow");
-        settings.setValue("lastsession", m_sessionFile);
-        settings.endGroup();
+    SVCERR << "MainWindow::checkpointSaved: checkpoint complete" << endl;
+}
 
-        SVCERR << "MainWindow::checkpointSession complete" << endl;
-        
-    } catch (const std::runtime_error &e) {
-        SVCERR << "MainWindow::checkpointSession: save failed: "
-               << e.what() << endl;
-        QMessageBox::critical
-            (this, tr("Failed to checkpoint session"),
-             tr("<b>Checkpoint failed</b>"
-                "<p>Session checkpoint file could not be saved: %1</p>")
-             .arg(e.what()));
-    }
+void
+MainWindow::checkpointFailed(QString file, QString error)
+{
+    SVCERR << "MainWindow::checkpointFailed: save to " << file
+           << " failed: " << error << endl;
+    QMessageBox::critical
+        (this, tr("Failed to checkpoint session"),
+         tr("<b>Checkpoint failed</b>"
+            "<p>Session checkpoint file could not be saved: %1</p>")
+         .arg(error));
 }
 
 SmallSession
@@ -2904,6 +4397,11 @@ MainWindow::makeSmallSession()
 
     session.mainFile = mainModel->getLocation();
 
+    auto mainMetadata = getFileMetadata(getMainModelId());
+    if (mainMetadata.isValid()) {
+        session.metadata[session.mainFile] = mainMetadata;
+    }
+
     std::set<QString> alreadyRecorded;
     alreadyRecorded.insert(session.mainFile);
     
@@ -2921,6 +4419,10 @@ MainWindow::makeSmallSession()
                 if (alreadyRecorded.find(location) == alreadyRecorded.end()) {
                     session.additionalFiles.push_back(location);
                     alreadyRecorded.insert(location);
+                    auto metadata = getFileMetadata(modelId);
+                    if (metadata.isValid()) {
+                        session.metadata[location] = metadata;
+                    }
                 }
             }
         }
@@ -2954,6 +4456,7 @@ MainWindow::mainModelChanged(ModelId modelId)
     }
     
     m_salientPending.clear();
+    m_salientMappedTo.clear();
     m_salientCalculating = false;
 
     MainWindowBase::mainModelChanged(modelId);
@@ -2967,14 +4470,22 @@ MainWindow::mainModelChanged(ModelId modelId)
 
     SVDEBUG << "Pane stack pane count = " << m_paneStack->getPaneCount() << endl;
 
+    // The main pane is created here, unless a session being loaded
+    // has already laid it out with a placeholder for us to fill in
+    Pane *pane = nullptr;
     auto model = ModelById::getAs<WaveFileModel>(modelId);
-    if (model &&
-        m_paneStack &&
-        (m_paneStack->getPaneCount() == 0)) {
+    if (model && m_paneStack) {
+        if (m_paneStack->getPaneCount() == 0) {
+            AddPaneCommand *command = new AddPaneCommand(this);
+            CommandHistory::getInstance()->addCommand(command);
+            pane = command->getPane();
+        } else if (hasOnlyPlaceholderLayers(m_paneStack->getPane(0))) {
+            pane = m_paneStack->getPane(0);
+        }
+    }
+
+    if (pane) {
         
-        AddPaneCommand *command = new AddPaneCommand(this);
-        CommandHistory::getInstance()->addCommand(command);
-        Pane *pane = command->getPane();
         Layer *newLayer =
             m_document->createMainModelLayer(LayerFactory::Waveform);
         newLayer->setObjectName(tr("Outline Waveform"));
@@ -3091,9 +4602,87 @@ MainWindow::alignmentComplete(ModelId amId)
     
     ModelId modelId = am->getAlignedModel();
     mapSalientFeatureLayer(modelId);
+
+    // Only cache the alignment if it hasn't since been superseded by
+    // a realignment using different settings
+    auto model = ModelById::get(modelId);
+    if (model && model->getAlignment() == amId) {
+        QString key = getAlignmentCacheKey(modelId);
+        if (key != "") {
+            AlignmentCache::getInstance()->store(key, modelId);
+        }
+    }
+    
     checkpointSession();
 }
 
+QString
+MainWindow::getContentHash(ModelId modelId)
+{
+    auto model = ModelById::getAs<ReadOnlyWaveFileModel>(modelId);
+    if (!model) return {};
+
+    // Hashing a whole file is far too slow for the GUI thread. The
+    // session loader will usually have done it already; if not, it
+    // is done in the background and we go without for now
+    AudioCache *cache = AudioCache::getInstance();
+    QString localPath = model->getLocalFilename();
+    QString hash = cache->getKnownContentHash(localPath);
+    if (hash == "") {
+        cache->requestContentHash(localPath);
+    }
+    return hash;
+}
+
+QString
+MainWindow::getAlignmentCacheKey(ModelId modelId)
+{
+    ModelId mainModelId = getMainModelId();
+    if (mainModelId.isNone() || modelId == mainModelId) {
+        return {};
+    }
+
+    return AlignmentCache::getInstance()->makeKey
+        (getContentHash(mainModelId),
+         getContentHash(modelId),
+         Align::getAlignmentPreference(),
+         Align::getUseSubsequenceAlignment());
+}
+
+bool
+MainWindow::restoreCachedAlignment(ModelId modelId)
+{
+    QString key = getAlignmentCacheKey(modelId);
+    if (key == "") return false;
+
+    return AlignmentCache::getInstance()->restore
+        (key, getMainModelId(), modelId);
+}
+
+vector<ModelId>
+MainWindow::getAdditionalAudioModels()
+{
+    vector<ModelId> models;
+    set<ModelId> seen;
+    
+    for (int i = 0; i < m_paneStack->getPaneCount(); ++i) {
+        Pane *p = m_paneStack->getPane(i);
+        for (int j = 0; j < p->getLayerCount(); ++j) {
+            auto modelId = p->getLayer(j)->getModel();
+            if (modelId == getMainModelId() ||
+                seen.find(modelId) != seen.end()) {
+                continue;
+            }
+            if (ModelById::getAs<WaveFileModel>(modelId)) {
+                models.push_back(modelId);
+                seen.insert(modelId);
+            }
+        }
+    }
+
+    return models;
+}
+
 void
 MainWindow::alignmentFailed(ModelId, QString message)
 {
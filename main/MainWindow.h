@@ -59,8 +59,16 @@ class QTreeView;
 class QPushButton;
 class KeyReference;
 class QScrollArea;
+class QTimer;
 class OSCMessage;
 class QToolButton;
+class SessionLoader;
+class TransformJobQueue;
+class SessionCheckpointer;
+class LayerMemoryGovernor;
+class QProgressDialog;
+class FileSource;
+class AudioFileReader;
 
 class MainWindow : public MainWindowBase
 {
@@ -96,12 +104,27 @@ protected slots:
     virtual void openLocation();
     virtual void openRecentSession();
     virtual void checkpointSession();
+    void checkpointSaved(QString file, QString label);
+    void checkpointFailed(QString file, QString error);
     virtual void browseRecordedAudio();
     virtual void newSession();
     virtual void preferences();
 
     void closeSession() override;
 
+    void sessionFileReady(int, QString, FileSource *, AudioFileReader *);
+    void sessionFileFailed(int, QString, QString);
+    void sessionLoadFinished();
+    void loadProgressCancelled();
+
+    void viewportChanged();
+    void viewportSettled();
+
+    void startSpeculativeModeLayers();
+    void enforceMemoryBudget();
+    void cancelSpeculativeModeLayers();
+    void playbackStatusChanged(bool);
+
     void outlineWaveformModeSelected();
     void standardWaveformModeSelected();
     void spectrogramModeSelected();
@@ -168,8 +191,12 @@ protected slots:
 
     void alignmentComplete(ModelId) override;
     void alignmentFailed(ModelId, QString) override;
+    virtual void alignmentProgressed(ModelId); // an aligned WaveFileModel
 
     virtual void salientLayerCompletionChanged(ModelId);
+    virtual void modeLayerCompletionChanged(ModelId);
+    virtual void modeLayerRestored(QString key, ModelId source,
+                                   ModelId model); // from FeatureCache
 
     void paneRightButtonMenuRequested(Pane *, QPoint) override { /* none */ }
     void panePropertiesRightButtonMenuRequested(Pane *, QPoint) override { /* none */ }
@@ -197,6 +224,8 @@ protected:
     AudioDial               *m_playSpeed;
     
     QScrollArea             *m_mainScroll;
+    QTimer                  *m_viewportTimer;
+    QTimer                  *m_speculationTimer;
 
     bool                     m_mainMenusCreated;
     QToolBar                *m_playbackToolBar;
@@ -237,6 +266,20 @@ protected:
     bool                     m_networkPermission;
     QString                  m_newerVersionIs;
 
+    SessionLoader           *m_sessionLoader;
+    TransformJobQueue       *m_transformJobs;
+    SessionCheckpointer     *m_checkpointer;
+    LayerMemoryGovernor     *m_memoryGovernor;
+    bool                     m_sessionOpening;
+    bool                     m_sessionLoadingMainFile;
+    std::vector<QString>     m_sessionPendingFiles;
+    bool                     m_sessionSkipFailedFiles;
+    std::vector<QString>     m_sessionFailedFiles;
+    int                      m_sessionFilesDone;
+    QPointer<QProgressDialog> m_loadProgress;
+    std::vector<QPointer<Pane>> m_sessionPlaceholderPanes;
+    std::map<ModelId, SmallSession::FileMetadata> m_fileMetadata;
+
     QString getReleaseText() const;
     
     void setupMenus() override;
@@ -262,11 +305,28 @@ protected:
     
     virtual void reselectMode();
     virtual void updateModeFromLayers(); // after loading a session
-    virtual void selectTransformDrivenMode(DisplayMode mode,
-                                           QString transformId,
-                                           Transform::ParameterMap parameters,
-                                           QString layerPropertyXml,
-                                           bool includeGhostReference);
+    struct TransformDrivenMode {
+        QString transformId;
+        Transform::ParameterMap parameters;
+        QString layerPropertyXml;
+        bool includeGhostReference;
+    };
+
+    // Return the transform and layer properties for a display mode
+    // that shows the output of a transform, or false if the mode is
+    // not one of those
+    bool getTransformDrivenMode(DisplayMode, TransformDrivenMode &);
+    
+    virtual void selectTransformDrivenMode(DisplayMode mode);
+
+    // Create a spectrogram or melodogram layer for the given pane
+    void addSpectrogramModeLayer(Pane *, DisplayMode mode,
+                                 ModelId createFrom);
+
+    // Create, or queue the calculation of, the layer for the current
+    // mode in a pane that lacks it because it was far from the
+    // viewport when the mode was selected
+    void addMissingModeLayer(Pane *, int paneIndex);
     DisplayMode m_displayMode;
 
     void closeEvent(QCloseEvent *e) override;
@@ -279,6 +339,16 @@ protected:
     virtual void addSalientFeatureLayer(Pane *, ModelId); // a WaveFileModel
     virtual void mapSalientFeatureLayer(ModelId); // a WaveFileModel
 
+    // Map further salient features into the mapped layer for a model
+    // whose alignment is still in progress, as far as the alignment
+    // path has settled. Aligners that publish their path only when
+    // finished, as MATCH does, leave nothing to map until then
+    void extendMappedSalientFeatureLayer(ModelId);
+
+    Pane *findPaneForModel(ModelId);
+    Layer *findMappedSalientLayer(Pane *);
+    Layer *addMappedSalientLayer(Pane *, ModelId mappedModelId);
+
     void mapAllSalientFeatureLayers();
 
     // Return the salient-feature layer in the given pane. If pane is
@@ -289,6 +359,15 @@ protected:
     
     bool m_salientCalculating;
     std::set<ModelId> m_salientPending; // Aligned WaveFileModels
+
+    // Aligned models whose salient features are being mapped while
+    // their alignment is in progress, with the reference frame up to
+    // which they have been mapped so far
+    std::map<ModelId, sv_frame_t> m_salientMappedTo;
+
+    // Derived models still being calculated, with the feature cache
+    // keys their results are to be stored under
+    std::map<ModelId, QString> m_featureCacheKeys;
     int m_salientColour;
     
     void updateVisibleRangeDisplay(Pane *p) const override;
@@ -313,8 +392,168 @@ protected:
     // Open a session from the given SmallSession file path
     void openSmallSessionFile(QString path);
 
+    // Report a failure to open a session and reset the session state
+    void sessionLoadFailed(QString errorText);
+
     bool approveAlignmentProgram();
 
+    // Return the content hash of the audio file behind the given
+    // wave file model, or an empty string if it has none or it is
+    // not known yet (in which case it is calculated in the background)
+    QString getContentHash(ModelId);
+
+    // Return the alignment cache key for aligning the given model
+    // against the main model with the current alignment settings
+    QString getAlignmentCacheKey(ModelId);
+
+    // Attach a cached alignment against the main model to the given
+    // model, if there is one. Return true if one was found
+    bool restoreCachedAlignment(ModelId);
+
+    // Return the feature cache key for the given transform run on
+    // the given source model
+    QString getFeatureCacheKey(const Transform &, ModelId source);
+
+    // Create a layer for the output of the given transform run on
+    // the given source model from the feature cache, or return
+    // nullptr if it isn't cached
+    Layer *restoreModeLayer(const Transform &, ModelId source);
+
+    // Start reading the output of the given transform run on the
+    // given source model from the feature cache in the background,
+    // to be installed in the pane by modeLayerRestored. Return false
+    // if it isn't cached
+    bool requestModeLayerRestore(Pane *, int paneIndex, DisplayMode mode,
+                                 Transform transform, ModelId source,
+                                 QString layerPropertyXml);
+
+    // Return true if a mode layer for the given pane and mode is
+    // being read from the feature cache
+    bool isRestoringModeLayer(Pane *, DisplayMode mode);
+
+    // Feature cache reads still in progress, by cache key
+    struct PendingRestore {
+        QPointer<Pane> pane;
+        int paneIndex;
+        DisplayMode mode;
+        Transform transform;
+        ModelId source;
+        QString layerPropertyXml;
+    };
+    std::multimap<QString, PendingRestore> m_pendingRestores;
+
+    // Queue the calculation of a mode layer for the given pane on
+    // the transform job queue
+    void queueModeLayer(Pane *, int paneIndex, DisplayMode mode,
+                        Transform transform, ModelId source,
+                        QString layerPropertyXml);
+
+    // Create a layer for the output of the given transform run on
+    // the given source model, starting the transform and arranging
+    // for its output to be cached when complete
+    Layer *createModeLayer(const Transform &, ModelId source);
+
+    // Name and style a new mode layer and add it to its pane
+    void installModeLayer(Pane *, int paneIndex, Layer *,
+                          QString name, QString layerPropertyXml);
+
+    // Called from the transform job queue to create a mode layer
+    // whose calculation was deferred. Returns nullptr if the layer
+    // is no longer wanted
+    Layer *startQueuedModeLayer(Pane *, int paneIndex, DisplayMode mode,
+                                Transform transform, ModelId source,
+                                QString layerPropertyXml);
+
+    // Called from the transform job queue to create a mode layer
+    // speculatively, without adding it to the pane, in case the user
+    // switches to its mode
+    Layer *startSpeculativeModeLayer(Pane *, DisplayMode mode,
+                                     Transform transform, ModelId source);
+
+    // Speculatively created mode layers not yet taken up, by pane and
+    // mode layer name
+    std::map<std::pair<Pane *, QString>, QPointer<Layer>> m_speculativeLayers;
+
+    // Return the model from which mode layers for the given pane
+    // should be derived
+    ModelId getModeSourceModel(Pane *);
+
+    // Called from the transform job queue to create the salient
+    // feature layer
+    Layer *startSalientFeatureLayer(Pane *, ModelId, Transform transform);
+
+    // Return the scheduling priority for calculations in the given
+    // pane: 0 for the current pane, 1 for other visible panes, 2 for
+    // the rest
+    int getPanePriority(Pane *);
+
+    // Return the visible part of the pane stack, in its own
+    // coordinates
+    QRect getVisiblePaneStackRect();
+
+    // Return true if the given pane is within or close to the
+    // visible part of the pane stack. Expensive mode layers are only
+    // created for panes for which this is true, and the rest are
+    // filled in as the user scrolls to them. The first pane always
+    // counts as near, as it supplies the ghost reference layers
+    bool isPaneNearViewport(Pane *);
+
+    // Return true if the given layer in the given pane was derived
+    // from that pane's own audio, rather than being a ghost borrowed
+    // from the reference pane
+    bool isPaneOwnLayer(Pane *, Layer *);
+
+    // Return true if a layer of the pane's own with the given mode
+    // name exists in the given pane
+    bool paneHasModeLayer(Pane *, QString modeName);
+
+    // Return true if the given layer is in the given pane
+    bool paneContainsLayer(Pane *, Layer *);
+
+    // Open all the audio files in a directory, decoding them in
+    // parallel and adding panes in name order as each is ready, with
+    // a progress dialog. Returns false if there are no audio files
+    bool openDirectory(QString dirPath);
+
+    // Open the given audio files or URLs in the same way, in order
+    void openFileList(const std::vector<QString> &paths);
+
+    // Count off one more file in the progress dialog, if any
+    void updateLoadProgress();
+
+    // Close the progress dialog and report any files that failed
+    void finishLoadProgress();
+
+    // Close the progress dialog without treating that as a cancel
+    void closeLoadProgress();
+
+    // Lay out one pane per file in the session, each holding a
+    // placeholder layer drawn from the metadata recorded in the
+    // session, if the session has metadata for every file
+    void createPlaceholderPanes(const SmallSession &);
+
+    // Remove placeholder layers from a pane once its real data is
+    // present
+    void removePlaceholderLayers(Pane *);
+
+    // Return true if the pane is still waiting for its session file
+    bool isPlaceholderPane(Pane *);
+
+    // Return true if the pane has nothing but placeholder layers in
+    // it (or nothing at all)
+    bool hasOnlyPlaceholderLayers(Pane *);
+
+    // Remove all placeholder panes still waiting for their files
+    void removePlaceholderPanes();
+
+    // Return the metadata to record in the session file for the
+    // given wave file model. Cached per model once the model is ready
+    SmallSession::FileMetadata getFileMetadata(ModelId);
+
+    // Return all wave file models shown in panes, other than the
+    // main model
+    std::vector<ModelId> getAdditionalAudioModels();
+
     enum SessionState {
         NoSession,
         SessionLoading,
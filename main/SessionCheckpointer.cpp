@@ -0,0 +1,158 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Lineup
+    Comparative visualisation and alignment of related audio recordings
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "SessionCheckpointer.h"
+
+#include "base/Debug.h"
+
+#include <QTimer>
+#include <QSettings>
+#include <QMutexLocker>
+
+#include <stdexcept>
+
+// Time to wait after the most recent submission before writing
+static const int quietPeriodMs = 500;
+
+SessionCheckpointer::SessionCheckpointer(QObject *parent) :
+    QObject(parent),
+    m_thread(nullptr),
+    m_timer(new QTimer(this)),
+    m_haveSubmitted(false),
+    m_haveReady(false),
+    m_writing(false),
+    m_exiting(false)
+{
+    m_timer->setSingleShot(true);
+    m_timer->setInterval(quietPeriodMs);
+    connect(m_timer, SIGNAL(timeout()), this, SLOT(quietPeriodEnded()));
+
+    m_thread = new WriterThread(this);
+    m_thread->start(QThread::LowPriority);
+}
+
+SessionCheckpointer::~SessionCheckpointer()
+{
+    flush();
+
+    {
+        QMutexLocker locker(&m_mutex);
+        m_exiting = true;
+        m_condition.wakeAll();
+    }
+
+    m_thread->wait();
+    delete m_thread;
+}
+
+void
+SessionCheckpointer::submit(const SmallSession &session,
+                            QString file, QString label)
+{
+    m_submitted.session = session;
+    m_submitted.file = file;
+    m_submitted.label = label;
+    m_haveSubmitted = true;
+    m_timer->start();
+}
+
+void
+SessionCheckpointer::quietPeriodEnded()
+{
+    handOver();
+}
+
+void
+SessionCheckpointer::handOver()
+{
+    if (!m_haveSubmitted) return;
+
+    QMutexLocker locker(&m_mutex);
+    m_ready = m_submitted;
+    m_haveReady = true;
+    m_haveSubmitted = false;
+    m_condition.wakeAll();
+}
+
+void
+SessionCheckpointer::flush()
+{
+    m_timer->stop();
+    handOver();
+
+    QMutexLocker locker(&m_mutex);
+    while (m_haveReady || m_writing) {
+        m_condition.wait(&m_mutex);
+    }
+}
+
+void
+SessionCheckpointer::WriterThread::run()
+{
+    SessionCheckpointer *c = m_checkpointer;
+
+    while (true) {
+
+        Checkpoint checkpoint;
+
+        {
+            QMutexLocker locker(&c->m_mutex);
+            while (!c->m_haveReady && !c->m_exiting) {
+                c->m_condition.wait(&c->m_mutex);
+            }
+            if (!c->m_haveReady) {
+                return;
+            }
+            checkpoint = c->m_ready;
+            c->m_haveReady = false;
+            c->m_writing = true;
+        }
+
+        SVDEBUG << "SessionCheckpointer: writing session file "
+                << checkpoint.file << endl;
+
+        QString error;
+
+        try {
+            SmallSession::save(checkpoint.session, checkpoint.file);
+
+            QSettings settings;
+            settings.beginGroup("MainWindow");
+            settings.setValue("lastsession", checkpoint.file);
+            settings.endGroup();
+
+        } catch (const std::runtime_error &e) {
+            error = e.what();
+            if (error == "") error = "Unknown error";
+        }
+
+        if (error == "") {
+            QMetaObject::invokeMethod
+                (c, "saved", Qt::QueuedConnection,
+                 Q_ARG(QString, checkpoint.file),
+                 Q_ARG(QString, checkpoint.label));
+        } else {
+            QMetaObject::invokeMethod
+                (c, "saveFailed", Qt::QueuedConnection,
+                 Q_ARG(QString, checkpoint.file),
+                 Q_ARG(QString, error));
+        }
+
+        {
+            QMutexLocker locker(&c->m_mutex);
+            c->m_writing = false;
+            c->m_condition.wakeAll();
+        }
+    }
+}
@@ -0,0 +1,108 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Lineup
+    Comparative visualisation and alignment of related audio recordings
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef VECT_SESSION_CHECKPOINTER_H
+#define VECT_SESSION_CHECKPOINTER_H
+
+#include "SmallSession.h"
+
+#include <QObject>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+
+class QTimer;
+
+/**
+ * Write session checkpoints from a background thread.
+ *
+ * Sessions submitted in quick succession are coalesced: only the
+ * most recent one is written once things have been quiet for a short
+ * while, and only the most recent one waiting to be written is kept
+ * if the writer is still busy with an earlier one.
+ */
+class SessionCheckpointer : public QObject
+{
+    Q_OBJECT
+
+public:
+    SessionCheckpointer(QObject *parent = 0);
+    virtual ~SessionCheckpointer();
+
+    /**
+     * Arrange for the given session to be saved to the given file,
+     * replacing any checkpoint not yet written. The label is passed
+     * back through saved() for the recent sessions list.
+     */
+    void submit(const SmallSession &session, QString file, QString label);
+
+    /**
+     * Write any checkpoint that is still waiting, and return when it
+     * has been written. For use on exit.
+     */
+    void flush();
+
+signals:
+    /**
+     * Emitted on the thread that owns this object when a checkpoint
+     * has been written.
+     */
+    void saved(QString file, QString label);
+
+    /**
+     * Emitted on the thread that owns this object when a checkpoint
+     * could not be written.
+     */
+    void saveFailed(QString file, QString error);
+
+protected slots:
+    void quietPeriodEnded();
+
+protected:
+    struct Checkpoint {
+        SmallSession session;
+        QString file;
+        QString label;
+    };
+
+    class WriterThread : public QThread
+    {
+    public:
+        WriterThread(SessionCheckpointer *checkpointer) :
+            m_checkpointer(checkpointer) { }
+        void run() override;
+    private:
+        SessionCheckpointer *m_checkpointer;
+    };
+
+    void handOver();
+
+    WriterThread *m_thread;
+    QTimer *m_timer;
+
+    // Checkpoint submitted but still within the quiet period, GUI
+    // thread only
+    Checkpoint m_submitted;
+    bool m_haveSubmitted;
+
+    // Shared with the writer thread, under m_mutex
+    QMutex m_mutex;
+    QWaitCondition m_condition;
+    Checkpoint m_ready;
+    bool m_haveReady;
+    bool m_writing;
+    bool m_exiting;
+};
+
+#endif
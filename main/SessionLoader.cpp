@@ -0,0 +1,568 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Lineup
+    Comparative visualisation and alignment of related audio recordings
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "SessionLoader.h"
+#include "AudioCache.h"
+
+#include "data/fileio/FileSource.h"
+#include "data/fileio/AudioFileReader.h"
+#include "data/fileio/AudioFileReaderFactory.h"
+#include "data/model/WaveFileModel.h"
+#include "base/Preferences.h"
+#include "base/Debug.h"
+
+#include <QRunnable>
+#include <QThread>
+#include <QSettings>
+#include <QCoreApplication>
+#include <QMutexLocker>
+
+#include <algorithm>
+
+class SessionLoader::DecodeTask : public QRunnable
+{
+public:
+    DecodeTask(SessionLoader *loader, int generation, int index) :
+        m_loader(loader), m_generation(generation), m_index(index) { }
+
+    void run() override {
+        m_loader->decode(m_generation, m_index);
+    }
+
+private:
+    SessionLoader *m_loader;
+    int m_generation;
+    int m_index;
+};
+
+class SessionLoader::FetchTask : public QRunnable
+{
+public:
+    FetchTask(SessionLoader *loader, int generation, int index) :
+        m_loader(loader), m_generation(generation), m_index(index) { }
+
+    void run() override {
+        m_loader->fetch(m_generation, m_index);
+    }
+
+private:
+    SessionLoader *m_loader;
+    int m_generation;
+    int m_index;
+};
+
+class SessionLoader::CacheTask : public QRunnable
+{
+public:
+    CacheTask(ModelId model, Pending pending) :
+        m_model(model), m_pending(pending) { }
+
+    void run() override {
+        auto model = ModelById::getAs<WaveFileModel>(m_model);
+        if (!model) return;
+        AudioCache::getInstance()->store(m_pending.localPath, model.get(),
+                                         m_pending.targetRate,
+                                         m_pending.normalised);
+    }
+
+private:
+    ModelId m_model;
+    Pending m_pending;
+};
+
+SessionLoader::SessionLoader(QObject *parent) :
+    QObject(parent),
+    m_targetRate(0),
+    m_generation(0),
+    m_nextToDeliver(0),
+    m_loading(false),
+    m_progressive(0),
+    m_delivering(false)
+{
+    m_pool.setMaxThreadCount(getConcurrencyLimit());
+    m_fetchPool.setMaxThreadCount(getConnectionLimit());
+}
+
+SessionLoader::~SessionLoader()
+{
+    cancel();
+    m_fetchPool.waitForDone(); // before m_pool, as it feeds it
+    m_pool.waitForDone();
+}
+
+int
+SessionLoader::getConcurrencyLimit()
+{
+    QSettings settings;
+    settings.beginGroup("Preferences");
+    int limit = settings.value("session-load-concurrency",
+                               QThread::idealThreadCount()).toInt();
+    settings.endGroup();
+    if (limit < 1) limit = 1;
+    return limit;
+}
+
+int
+SessionLoader::getConnectionLimit()
+{
+    QSettings settings;
+    settings.beginGroup("Preferences");
+    int limit = settings.value("remote-fetch-concurrency", 4).toInt();
+    settings.endGroup();
+    if (limit < 1) limit = 1;
+    return limit;
+}
+
+bool
+SessionLoader::isLoading() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_loading;
+}
+
+void
+SessionLoader::load(std::vector<QString> paths, sv_samplerate_t targetRate)
+{
+    cancel();
+
+    m_fetchPool.setMaxThreadCount(getConnectionLimit());
+
+    int generation = 0;
+
+    {
+        QMutexLocker locker(&m_mutex);
+        updatePoolSize();
+        generation = m_generation;
+        m_targetRate = targetRate;
+        m_nextToDeliver = 0;
+        m_results = std::vector<Result>(paths.size());
+        for (int i = 0; in_range_for(paths, i); ++i) {
+            m_results[i].path = paths[i];
+        }
+        m_loading = !paths.empty();
+    }
+
+    SVDEBUG << "SessionLoader::load: loading " << paths.size()
+            << " file(s) with up to " << m_pool.maxThreadCount()
+            << " thread(s), target rate " << targetRate << endl;
+
+    if (paths.empty()) {
+        emit finished();
+        return;
+    }
+
+    for (int i = 0; in_range_for(paths, i); ++i) {
+        start(generation, i, paths[i]);
+    }
+}
+
+void
+SessionLoader::append(std::vector<QString> paths, sv_samplerate_t targetRate)
+{
+    if (paths.empty()) return;
+    
+    int generation = 0;
+    int first = 0;
+
+    {
+        QMutexLocker locker(&m_mutex);
+        if (!m_loading) {
+            locker.unlock();
+            load(paths, targetRate);
+            return;
+        }
+        generation = m_generation;
+        first = int(m_results.size());
+        for (const auto &p: paths) {
+            Result r;
+            r.path = p;
+            m_results.push_back(r);
+        }
+    }
+
+    SVDEBUG << "SessionLoader::append: adding " << paths.size()
+            << " file(s) to load in progress" << endl;
+
+    for (int i = 0; in_range_for(paths, i); ++i) {
+        start(generation, first + i, paths[i]);
+    }
+}
+
+void
+SessionLoader::start(int generation, int index, QString path)
+{
+    // Remote files are downloaded on a separate pool, limited to the
+    // number of connections we are willing to open at once, and each
+    // one is passed on for decoding as soon as it has arrived. Local
+    // files go straight to the decoding pool
+    
+    if (FileSource::isRemote(path)) {
+        m_fetchPool.start(new FetchTask(this, generation, index));
+    } else {
+        m_pool.start(new DecodeTask(this, generation, index));
+    }
+}
+
+void
+SessionLoader::cancel()
+{
+    // Tasks that have not started yet can simply be dropped; those
+    // already running will notice the generation change when they
+    // finish, and their results will be thrown away
+    m_fetchPool.clear();
+    m_pool.clear();
+
+    QMutexLocker locker(&m_mutex);
+    ++m_generation;
+    for (auto &r: m_results) {
+        discard(r);
+    }
+    m_results.clear();
+    m_nextToDeliver = 0;
+    m_loading = false;
+}
+
+void
+SessionLoader::discard(Result &r)
+{
+    if (r.progressive && r.reader) {
+        --m_progressive; // we hold m_mutex already
+        updatePoolSize();
+    }
+    delete r.reader;
+    r.reader = nullptr;
+    delete r.source;
+    r.source = nullptr;
+}
+
+bool
+SessionLoader::claimProgressive()
+{
+    // Progressive decodes and the pool's own threads share the one
+    // budget. The pool always keeps at least one thread, so that the
+    // files still waiting to be opened are never starved, which
+    // leaves one fewer place for progressive decodes
+    if (m_progressive >= getConcurrencyLimit() - 1) {
+        return false;
+    }
+    ++m_progressive;
+    updatePoolSize();
+    return true;
+}
+
+void
+SessionLoader::releaseProgressive()
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_progressive > 0) --m_progressive;
+    updatePoolSize();
+}
+
+void
+SessionLoader::updatePoolSize()
+{
+    // Threads already running carry on if this shrinks the pool, but
+    // no more are started until the count has fallen back below it
+    m_pool.setMaxThreadCount
+        (std::max(1, getConcurrencyLimit() - m_progressive));
+}
+
+void
+SessionLoader::fetch(int generation, int index)
+{
+    QString path;
+
+    {
+        QMutexLocker locker(&m_mutex);
+        if (generation != m_generation) return;
+        path = m_results[index].path;
+    }
+
+    SVDEBUG << "SessionLoader::fetch: fetching \"" << path << "\" in thread "
+            << QThread::currentThreadId() << endl;
+
+    FileSource *source = new FileSource(path);
+    if (source->isAvailable()) {
+        source->waitForData();
+    }
+
+    // Only this thread can hand the source on to another, and the
+    // GUI thread is where it will end up
+    source->moveToThread(QCoreApplication::instance()->thread());
+
+    {
+        QMutexLocker locker(&m_mutex);
+        if (generation == m_generation) {
+            m_results[index].source = source;
+            source = nullptr;
+        }
+    }
+
+    if (source) {
+        SVDEBUG << "SessionLoader::fetch: load of \"" << path
+                << "\" was cancelled, discarding" << endl;
+        delete source;
+        return;
+    }
+
+    m_pool.start(new DecodeTask(this, generation, index));
+}
+
+void
+SessionLoader::decode(int generation, int index)
+{
+    QString path;
+    sv_samplerate_t targetRate = 0;
+    FileSource *source = nullptr;
+
+    {
+        QMutexLocker locker(&m_mutex);
+        if (generation != m_generation) return;
+        path = m_results[index].path;
+        targetRate = m_targetRate;
+        source = m_results[index].source; // if already fetched
+        m_results[index].source = nullptr;
+    }
+
+    SVDEBUG << "SessionLoader::decode: decoding \"" << path << "\" in thread "
+            << QThread::currentThreadId() << endl;
+
+    if (!source) {
+        source = new FileSource(path);
+    }
+    AudioFileReader *reader = nullptr;
+    bool progressive = false;
+    Pending pending;
+    QString error;
+
+    if (!source->isAvailable()) {
+        error = tr("File or URL \"%1\" could not be retrieved").arg(path);
+    } else {
+
+        source->waitForData();
+
+        QString localPath = source->getLocalFilename();
+        bool normalised = Preferences::getInstance()->getNormaliseAudio();
+
+        // A previous session may already have left the decoded and
+        // resampled audio in the cache, in which case we don't need
+        // to go near the decoder at all
+
+        reader = AudioCache::getInstance()->getCachedReader
+            (localPath, source->getLocation(), targetRate, normalised);
+
+        if (!reader) {
+
+            // Otherwise we would rather hand the file over as soon as
+            // it has been opened and let it decode in the background,
+            // so that whatever is waiting on its model can get going
+            // before it is complete - as long as there is room for
+            // it within the concurrency limit (see claimProgressive)
+            {
+                QMutexLocker locker(&m_mutex);
+                progressive = claimProgressive();
+            }
+
+            AudioFileReaderFactory::Parameters params;
+            params.targetRate = targetRate;
+            params.normalisation =
+                (normalised ?
+                 AudioFileReaderFactory::Normalisation::Peak :
+                 AudioFileReaderFactory::Normalisation::None);
+            params.threadingMode =
+                (progressive ?
+                 AudioFileReaderFactory::ThreadingMode::Threaded :
+                 AudioFileReaderFactory::ThreadingMode::NotThreaded);
+
+            reader = AudioFileReaderFactory::createReader(*source, params);
+
+            if (!reader || !reader->isOK()) {
+                if (reader) error = reader->getError();
+                if (error == "") {
+                    error = tr("Audio file \"%1\" could not be decoded")
+                        .arg(path);
+                }
+                delete reader;
+                reader = nullptr;
+                if (progressive) {
+                    releaseProgressive();
+                    progressive = false;
+                }
+            } else if (!progressive) {
+                AudioCache::getInstance()->store
+                    (localPath, reader, targetRate, normalised);
+            } else {
+                // Can't cache it until it's all there
+                pending.localPath = localPath;
+                pending.targetRate = targetRate;
+                pending.normalised = normalised;
+            }
+        }
+    }
+
+    // The reader and source belong to the GUI thread from here on
+    QThread *guiThread = QCoreApplication::instance()->thread();
+    if (source->thread() == QThread::currentThread()) {
+        source->moveToThread(guiThread);
+    }
+    if (reader) reader->moveToThread(guiThread);
+
+    {
+        QMutexLocker locker(&m_mutex);
+        if (generation != m_generation) {
+            SVDEBUG << "SessionLoader::decode: load of \"" << path
+                    << "\" was cancelled, discarding" << endl;
+            if (progressive) {
+                --m_progressive;
+                updatePoolSize();
+            }
+            delete reader;
+            delete source;
+            return;
+        }
+        Result &r = m_results[index];
+        r.done = true;
+        r.progressive = progressive;
+        r.source = source;
+        r.reader = reader;
+        r.error = error;
+        r.pending = pending;
+    }
+
+    QMetaObject::invokeMethod(this, "deliver", Qt::QueuedConnection);
+}
+
+void
+SessionLoader::deliver()
+{
+    while (true) {
+
+        Result r;
+        int index = 0;
+        int generation = 0;
+        bool finishedNow = false;
+
+        {
+            QMutexLocker locker(&m_mutex);
+            if (!m_loading ||
+                !in_range_for(m_results, m_nextToDeliver) ||
+                !m_results[m_nextToDeliver].done) {
+                return;
+            }
+            index = m_nextToDeliver++;
+            r = m_results[index];
+            m_results[index].source = nullptr;
+            m_results[index].reader = nullptr;
+            m_results[index].progressive = false;
+            generation = m_generation;
+            if (!in_range_for(m_results, m_nextToDeliver)) {
+                m_loading = false;
+                finishedNow = true;
+            }
+        }
+
+        // Receivers may cancel or restart the load from within these
+        // signals, so we check the generation again after each one
+
+        if (r.reader) {
+            // A progressive decode stays counted until the receiver's
+            // model is ready, if it tells us about it in trackModel,
+            // or until now if it doesn't
+            m_delivering = r.progressive;
+            m_deliveringPending = r.pending;
+            emit fileReady(index, r.path, r.source, r.reader);
+            if (m_delivering) {
+                m_delivering = false;
+                releaseProgressive();
+            }
+        } else {
+            delete r.source;
+            emit fileFailed(index, r.path, r.error);
+        }
+
+        {
+            QMutexLocker locker(&m_mutex);
+            if (generation != m_generation) return;
+        }
+
+        if (finishedNow) {
+            emit finished();
+            return;
+        }
+    }
+}
+
+void
+SessionLoader::trackModel(ModelId modelId)
+{
+    if (!m_delivering) return;
+    m_delivering = false;
+
+    auto model = ModelById::get(modelId);
+    if (!model) {
+        releaseProgressive();
+        return;
+    }
+
+    Pending pending = m_deliveringPending;
+
+    if (model->isReady()) {
+        releaseProgressive();
+        QThreadPool::globalInstance()->start(new CacheTask(modelId, pending));
+        return;
+    }
+
+    pending.model = model.get();
+    m_awaitingReady[modelId] = pending;
+
+    connect(model.get(), SIGNAL(ready(ModelId)),
+            this, SLOT(modelReady(ModelId)));
+    connect(model.get(), SIGNAL(destroyed(QObject *)),
+            this, SLOT(modelDestroyed(QObject *)));
+}
+
+void
+SessionLoader::modelReady(ModelId modelId)
+{
+    auto itr = m_awaitingReady.find(modelId);
+    if (itr == m_awaitingReady.end()) return;
+
+    Pending pending = itr->second;
+    m_awaitingReady.erase(itr);
+
+    if (auto model = ModelById::get(modelId)) {
+        disconnect(model.get(), nullptr, this, nullptr);
+    }
+
+    SVDEBUG << "SessionLoader::modelReady: decode of \""
+            << pending.localPath << "\" complete, caching" << endl;
+
+    releaseProgressive();
+    QThreadPool::globalInstance()->start(new CacheTask(modelId, pending));
+}
+
+void
+SessionLoader::modelDestroyed(QObject *object)
+{
+    // The model went away before it finished decoding: nothing to
+    // cache, but its decode no longer counts against the limit
+    for (auto itr = m_awaitingReady.begin(); itr != m_awaitingReady.end();
+         ++itr) {
+        if (itr->second.model == object) {
+            m_awaitingReady.erase(itr);
+            releaseProgressive();
+            return;
+        }
+    }
+}
@@ -0,0 +1,182 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Lineup
+    Comparative visualisation and alignment of related audio recordings
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef VECT_SESSION_LOADER_H
+#define VECT_SESSION_LOADER_H
+
+#include <QObject>
+#include <QString>
+#include <QMutex>
+#include <QThreadPool>
+
+#include "base/BaseTypes.h"
+#include "data/model/Model.h"
+
+#include <vector>
+#include <map>
+
+class FileSource;
+class AudioFileReader;
+
+/**
+ * Decode and resample a list of audio files on a pool of worker
+ * threads, handing the results back to the GUI thread in the order
+ * in which the files were given.
+ *
+ * The number of files decoded at once is limited to the value of
+ * the "session-load-concurrency" preference, defaulting to the
+ * number of available cores. Remote files are downloaded first, on
+ * a separate pool limited to the "remote-fetch-concurrency"
+ * preference (default 4) so as to bound the number of connections
+ * open at once, and decoded as soon as each has arrived.
+ *
+ * Files that are not already in the AudioCache are decoded
+ * progressively where possible: the reader is handed over as soon
+ * as the file has been opened, and carries on decoding in the
+ * background, so that its model can be shown and analysed while it
+ * is still filling. Progressive decodes and the pool's threads
+ * share the session-load-concurrency limit: the pool shrinks by one
+ * thread for each progressive decode under way, and always keeps at
+ * least one. Files beyond that are decoded completely on the pool
+ * as before. A receiver that
+ * calls trackModel() for the model it makes from a progressively
+ * decoded reader lets the loader know when that decode is over, and
+ * have the result written to the AudioCache once it is.
+ */
+class SessionLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    SessionLoader(QObject *parent = 0);
+    virtual ~SessionLoader();
+
+    /**
+     * Start loading the given files, resampling to targetRate if it
+     * is non-zero. Any load already in progress is cancelled first.
+     */
+    void load(std::vector<QString> paths, sv_samplerate_t targetRate);
+
+    /**
+     * Add the given files to the end of the load in progress, at its
+     * target rate, to be delivered after those already given. If no
+     * load is in progress, start one as load() would.
+     */
+    void append(std::vector<QString> paths, sv_samplerate_t targetRate);
+
+    /**
+     * Abandon the current load. Files already being decoded will
+     * finish in the background but their results will be discarded,
+     * and no further signals will be emitted for them.
+     */
+    void cancel();
+
+    bool isLoading() const;
+
+    /**
+     * Called by a receiver of fileReady, from within its slot, with
+     * the id of the model it has made from the reader. If the reader
+     * is still decoding, the loader watches the model, caching its
+     * audio and admitting further progressive decodes once it is
+     * ready. Otherwise this does nothing.
+     */
+    void trackModel(ModelId model);
+
+    static int getConcurrencyLimit();
+    static int getConnectionLimit();
+
+signals:
+    /**
+     * Emitted on the GUI thread, in the original file order, when a
+     * file has been decoded. The receiver takes ownership of both
+     * source and reader.
+     */
+    void fileReady(int index, QString path,
+                   FileSource *source, AudioFileReader *reader);
+
+    /**
+     * Emitted on the GUI thread, in the original file order, when a
+     * file could not be opened or decoded.
+     */
+    void fileFailed(int index, QString path, QString error);
+
+    /**
+     * Emitted when every file has been reported through fileReady or
+     * fileFailed.
+     */
+    void finished();
+
+protected slots:
+    void deliver();
+    void modelReady(ModelId);
+    void modelDestroyed(QObject *);
+
+protected:
+    class DecodeTask;
+    friend class DecodeTask;
+    class FetchTask;
+    friend class FetchTask;
+    class CacheTask;
+
+    struct Pending {
+        QString localPath;
+        sv_samplerate_t targetRate;
+        bool normalised;
+        const QObject *model;
+        Pending() : targetRate(0), normalised(false), model(nullptr) { }
+    };
+
+    struct Result {
+        QString path;
+        bool done;
+        bool progressive;
+        FileSource *source;
+        AudioFileReader *reader;
+        QString error;
+        Pending pending;
+        Result() : done(false), progressive(false),
+                   source(nullptr), reader(nullptr) { }
+    };
+
+    void start(int generation, int index, QString path);
+    void fetch(int generation, int index);
+    void decode(int generation, int index);
+    void discard(Result &);
+
+    // Claim a place for a progressive decode, if one is free. Caller
+    // must hold m_mutex
+    bool claimProgressive();
+
+    // Give up a place claimed with claimProgressive
+    void releaseProgressive();
+
+    // Size the decode pool to whatever the progressive decodes leave
+    // of the concurrency limit. Caller must hold m_mutex
+    void updatePoolSize();
+
+    QThreadPool m_pool;
+    QThreadPool m_fetchPool;
+    mutable QMutex m_mutex;
+    std::vector<Result> m_results;
+    sv_samplerate_t m_targetRate;
+    int m_generation;
+    int m_nextToDeliver;
+    bool m_loading;
+    int m_progressive;
+    bool m_delivering;
+    Pending m_deliveringPending;
+    std::map<ModelId, Pending> m_awaitingReady;
+};
+
+#endif
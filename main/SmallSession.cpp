@@ -22,6 +22,43 @@
 #include <QTextCodec>
 #include <QXmlDefaultHandler>
 
+static QString
+metadataAttributes(const SmallSession &session, QString file)
+{
+    auto itr = session.metadata.find(file);
+    if (itr == session.metadata.end() || !itr->second.isValid()) {
+        return {};
+    }
+
+    const SmallSession::FileMetadata &md = itr->second;
+
+    QByteArray summary(reinterpret_cast<const char *>(md.summary.data()),
+                       int(md.summary.size()));
+
+    return QString(" frames=\"%1\" channels=\"%2\" rate=\"%3\" "
+                   "fingerprint=\"%4\" summary=\"%5\"")
+        .arg(md.frames)
+        .arg(md.channels)
+        .arg(md.sampleRate)
+        .arg(XmlExportable::encodeEntities(md.fingerprint))
+        .arg(QString::fromLatin1(summary.toBase64()));
+}
+
+bool
+SmallSession::hasCompleteMetadata() const
+{
+    auto valid = [this](QString file) {
+        auto itr = metadata.find(file);
+        return itr != metadata.end() && itr->second.isValid();
+    };
+    
+    if (!valid(mainFile)) return false;
+    for (auto f: additionalFiles) {
+        if (!valid(f)) return false;
+    }
+    return true;
+}
+
 void
 SmallSession::save(const SmallSession &session, QString sessionFile)
 {
@@ -40,17 +77,24 @@ SmallSession::save(const SmallSession &session, QString sessionFile)
         << "<!DOCTYPE sonic-lineup>\n"
         << "<vect>\n";
 
+    // File URIs may contain percent-escapes, so each line is
+    // substituted in a single call: chained arg() calls would read
+    // an escape such as %2F as a further placeholder
+    
     out << (QString("  <model id=\"1\" type=\"wavefile\" "
-                    "mainModel=\"true\" file=\"%1\"/>\n")
-            .arg(XmlExportable::encodeEntities(session.mainFile)));
+                    "mainModel=\"true\" file=\"%1\"%2/>\n")
+            .arg(XmlExportable::encodeEntities(session.mainFile),
+                 metadataAttributes(session, session.mainFile)));
 
     for (int i = 0; in_range_for(session.additionalFiles, i); ++i) {
 
         out << (QString("  <model id=\"%1\" type=\"wavefile\" "
-                        "mainModel=\"false\" file=\"%2\"/>\n")
-                .arg(i + 2)
-                .arg(XmlExportable::encodeEntities
-                     (session.additionalFiles[i])));
+                        "mainModel=\"false\" file=\"%2\"%3/>\n")
+                .arg(QString::number(i + 2),
+                     XmlExportable::encodeEntities
+                     (session.additionalFiles[i]),
+                     metadataAttributes
+                     (session, session.additionalFiles[i])));
     }
 
     out << "</vect>\n";
@@ -109,6 +153,8 @@ public:
             
             QString file = attributes.value("file");
 
+            readMetadata(file, attributes);
+
             if (isMainModel) {
                 if (m_session.mainFile != "") {
                     m_errorString = "Duplicate main model found";
@@ -125,6 +171,32 @@ public:
         }
     }
     
+    void readMetadata(QString file, const QXmlAttributes &attributes) {
+
+        // These attributes are absent from sessions saved by older
+        // versions, in which case we just don't record anything
+        
+        bool ok = false;
+        SmallSession::FileMetadata md;
+        
+        md.frames = attributes.value("frames").trimmed().toLongLong(&ok);
+        if (!ok) return;
+        md.channels = attributes.value("channels").trimmed().toInt(&ok);
+        if (!ok) return;
+        md.sampleRate = attributes.value("rate").trimmed().toDouble(&ok);
+        if (!ok) return;
+        
+        md.fingerprint = attributes.value("fingerprint").trimmed();
+
+        QByteArray summary = QByteArray::fromBase64
+            (attributes.value("summary").trimmed().toLatin1());
+        md.summary = std::vector<unsigned char>(summary.begin(), summary.end());
+
+        if (md.isValid()) {
+            m_session.metadata[file] = md;
+        }
+    }
+    
     bool error(const QXmlParseException &exception) override {
         m_errorString =
             QString("%1 at line %2, column %3")
@@ -16,8 +16,11 @@
 #define VECT_SMALL_SESSION_H
 
 #include <vector>
+#include <map>
 #include <QString>
 
+#include "base/BaseTypes.h"
+
 /**
  * Just a container for the origin URIs of the files in a session,
  * with load/save from/to XML.
@@ -27,6 +30,38 @@ struct SmallSession
     QString mainFile;
     std::vector<QString> additionalFiles;
 
+    /**
+     * Optional description of a file in the session, recorded so
+     * that the layout of the session can be shown before the file
+     * itself has been decoded. Sessions saved by older versions lack
+     * this entirely.
+     */
+    struct FileMetadata {
+        sv_frame_t frames;
+        int channels;
+        sv_samplerate_t sampleRate;
+        QString fingerprint;
+        std::vector<unsigned char> summary; // peak levels, 0-255
+        
+        FileMetadata() : frames(0), channels(0), sampleRate(0) { }
+
+        bool isValid() const {
+            return frames > 0 && channels > 0 && sampleRate > 0;
+        }
+    };
+
+    /**
+     * Metadata for some or all of the files, keyed by their URIs as
+     * found in mainFile and additionalFiles.
+     */
+    std::map<QString, FileMetadata> metadata;
+
+    /**
+     * Return true if there is valid metadata for every file in the
+     * session.
+     */
+    bool hasCompleteMetadata() const;
+
     /**
      * Save the given session to the given filename.
      * Throw std::runtime_error if the save fails.
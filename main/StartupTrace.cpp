@@ -0,0 +1,175 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Lineup
+    Comparative visualisation and alignment of related audio recordings
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "StartupTrace.h"
+
+#include "base/Debug.h"
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <QFile>
+#include <QTextStream>
+#include <QWidget>
+#include <QEvent>
+#include <QCoreApplication>
+
+#include <vector>
+
+namespace {
+
+struct TraceEvent {
+    QString name;
+    char phase;     // 'X' for a complete span, 'i' for an instant
+    qint64 start;   // microseconds
+    qint64 duration;
+    quint64 thread;
+};
+
+QMutex traceMutex;
+bool traceEnabled = false;
+QString tracePath;
+QElapsedTimer traceClock;
+std::vector<TraceEvent> traceEvents;
+
+qint64 now()
+{
+    return traceClock.nsecsElapsed() / 1000;
+}
+
+quint64 currentThread()
+{
+    return quint64(reinterpret_cast<quintptr>(QThread::currentThreadId()));
+}
+
+void record(QString name, char phase, qint64 start, qint64 duration)
+{
+    QMutexLocker locker(&traceMutex);
+    traceEvents.push_back({ name, phase, start, duration, currentThread() });
+}
+
+QString jsonString(QString s)
+{
+    s.replace("\\", "\\\\");
+    s.replace("\"", "\\\"");
+    s.replace("\n", "\\n");
+    return "\"" + s + "\"";
+}
+
+class FirstPaintWatcher : public QObject
+{
+public:
+    FirstPaintWatcher(QObject *parent) : QObject(parent) { }
+
+    bool eventFilter(QObject *obj, QEvent *e) override {
+        if (e->type() == QEvent::Paint) {
+            StartupTrace::instant("first paint");
+            StartupTrace::write();
+            obj->removeEventFilter(this);
+            deleteLater();
+        }
+        return false;
+    }
+};
+
+}
+
+void
+StartupTrace::enable(QString outputPath)
+{
+    QMutexLocker locker(&traceMutex);
+    if (traceEnabled) return;
+    traceEnabled = true;
+    tracePath = outputPath;
+    traceClock.start();
+}
+
+bool
+StartupTrace::isEnabled()
+{
+    QMutexLocker locker(&traceMutex);
+    return traceEnabled;
+}
+
+void
+StartupTrace::instant(QString name)
+{
+    if (!isEnabled()) return;
+    record(name, 'i', now(), 0);
+}
+
+void
+StartupTrace::watchFirstPaint(QWidget *widget)
+{
+    if (!isEnabled() || !widget) return;
+    widget->installEventFilter(new FirstPaintWatcher(widget));
+}
+
+void
+StartupTrace::write()
+{
+    QMutexLocker locker(&traceMutex);
+    if (!traceEnabled) return;
+
+    QFile f(tracePath);
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        SVCERR << "StartupTrace: failed to open " << tracePath
+               << " for writing" << endl;
+        return;
+    }
+
+    QTextStream out(&f);
+    out << "{\"traceEvents\":[\n";
+
+    qint64 pid = QCoreApplication::applicationPid();
+
+    for (size_t i = 0; i < traceEvents.size(); ++i) {
+        const TraceEvent &e = traceEvents[i];
+        out << "{\"name\":" << jsonString(e.name)
+            << ",\"cat\":\"startup\",\"ph\":\"" << e.phase << "\""
+            << ",\"ts\":" << e.start;
+        if (e.phase == 'X') {
+            out << ",\"dur\":" << e.duration;
+        } else {
+            out << ",\"s\":\"p\"";
+        }
+        out << ",\"pid\":" << pid << ",\"tid\":" << e.thread << "}"
+            << (i + 1 < traceEvents.size() ? ",\n" : "\n");
+    }
+
+    out << "],\"displayTimeUnit\":\"ms\"}\n";
+}
+
+StartupTrace::Span::Span(QString name) :
+    m_name(name),
+    m_start(-1)
+{
+    if (StartupTrace::isEnabled()) {
+        m_start = now();
+    }
+}
+
+StartupTrace::Span::~Span()
+{
+    end();
+}
+
+void
+StartupTrace::Span::end()
+{
+    if (m_start < 0) return;
+    record(m_name, 'X', m_start, now() - m_start);
+    m_start = -1;
+}
@@ -0,0 +1,77 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Lineup
+    Comparative visualisation and alignment of related audio recordings
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef VECT_STARTUP_TRACE_H
+#define VECT_STARTUP_TRACE_H
+
+#include <QString>
+
+class QWidget;
+
+/**
+ * Record timings of named spans during startup, and write them out
+ * in Chrome trace event format (viewable in chrome://tracing or
+ * Perfetto).
+ *
+ * Tracing is off unless enable() is called, which main() does if
+ * the SONIC_LINEUP_TRACE environment variable is set (to the output
+ * file path) or the --trace-startup option is given. When off, all
+ * of the recording functions return immediately.
+ */
+class StartupTrace
+{
+public:
+    /**
+     * Start tracing, with times measured from now. The trace will be
+     * written to the given file.
+     */
+    static void enable(QString outputPath);
+
+    static bool isEnabled();
+
+    /**
+     * Record a momentary event.
+     */
+    static void instant(QString name);
+
+    /**
+     * Record an event when the given widget is first painted.
+     */
+    static void watchFirstPaint(QWidget *widget);
+
+    /**
+     * Write everything recorded so far to the output file, replacing
+     * anything written previously.
+     */
+    static void write();
+
+    /**
+     * Record the time from construction to destruction, or to the
+     * first call to end(), as a span with the given name.
+     */
+    class Span
+    {
+    public:
+        Span(QString name);
+        ~Span();
+
+        void end();
+
+    private:
+        QString m_name;
+        qint64 m_start;
+    };
+};
+
+#endif
@@ -0,0 +1,273 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Lineup
+    Comparative visualisation and alignment of related audio recordings
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "TransformJobQueue.h"
+
+#include "view/Pane.h"
+#include "layer/Layer.h"
+#include "base/Debug.h"
+
+#include <QThread>
+
+TransformJobQueue::TransformJobQueue(Prioritiser prioritiser,
+                                     QObject *parent) :
+    QObject(parent),
+    m_prioritiser(prioritiser),
+    m_sequence(0),
+    m_dispatchScheduled(false)
+{
+}
+
+TransformJobQueue::~TransformJobQueue()
+{
+}
+
+int
+TransformJobQueue::getConcurrencyLimit()
+{
+    int limit = QThread::idealThreadCount();
+    if (limit < 1) limit = 1;
+    return limit;
+}
+
+int
+TransformJobQueue::getSpeculativeLimit()
+{
+    int limit = getConcurrencyLimit() / 4;
+    if (limit < 1) limit = 1;
+    return limit;
+}
+
+void
+TransformJobQueue::add(Pane *pane, QString name, Starter starter)
+{
+    // The user wants the cores for this, so anything we were only
+    // guessing they might want can give way
+    clearSpeculative();
+    if (!m_speculativeRunning.empty()) {
+        emit speculationInterrupted();
+    }
+    
+    enqueue(pane, name, starter, false);
+}
+
+void
+TransformJobQueue::addSpeculative(Pane *pane, QString name, Starter starter)
+{
+    enqueue(pane, name, starter, true);
+}
+
+void
+TransformJobQueue::enqueue(Pane *pane, QString name, Starter starter,
+                           bool speculative)
+{
+    if (isPending(pane, name)) return;
+
+    Job job;
+    job.pane = pane;
+    job.name = name;
+    job.starter = starter;
+    job.sequence = m_sequence++;
+    job.speculative = speculative;
+    m_pending.push_back(job);
+
+    // Don't start anything until the caller has finished queueing,
+    // so that the whole set of jobs is considered in priority order
+    scheduleDispatch();
+}
+
+bool
+TransformJobQueue::isPending(Pane *pane, QString name) const
+{
+    for (const auto &job: m_pending) {
+        if (job.pane == pane && job.name == name) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool
+TransformJobQueue::isIdle() const
+{
+    if (!m_running.empty()) return false;
+    for (const auto &job: m_pending) {
+        if (!job.speculative) return false;
+    }
+    return true;
+}
+
+void
+TransformJobQueue::clear()
+{
+    m_pending.clear();
+}
+
+void
+TransformJobQueue::clearExcept(QString name)
+{
+    std::vector<Job> remaining;
+    for (const auto &job: m_pending) {
+        if (job.name == name) remaining.push_back(job);
+    }
+    m_pending = remaining;
+}
+
+void
+TransformJobQueue::clearSpeculative()
+{
+    std::vector<Job> remaining;
+    for (const auto &job: m_pending) {
+        if (!job.speculative) remaining.push_back(job);
+    }
+    m_pending = remaining;
+}
+
+void
+TransformJobQueue::promote(Layer *layer)
+{
+    if (m_speculativeRunning.find(layer) == m_speculativeRunning.end()) {
+        return;
+    }
+    m_speculativeRunning.erase(layer);
+    m_running.insert(layer);
+}
+
+void
+TransformJobQueue::scheduleDispatch()
+{
+    if (m_dispatchScheduled) return;
+    m_dispatchScheduled = true;
+    QMetaObject::invokeMethod(this, "dispatch", Qt::QueuedConnection);
+}
+
+int
+TransformJobQueue::findNext(bool speculative, int &bestPriority)
+{
+    int best = -1;
+    bestPriority = 0;
+
+    for (int i = 0; in_range_for(m_pending, i); ++i) {
+        const Job &job = m_pending[i];
+        if (job.speculative != speculative) {
+            continue;
+        }
+        if (!job.pane) {
+            return i; // dead pane, just get rid of it
+        }
+        int priority = m_prioritiser(job.pane);
+        if (best < 0 ||
+            priority < bestPriority ||
+            (priority == bestPriority &&
+             job.sequence < m_pending[best].sequence)) {
+            best = i;
+            bestPriority = priority;
+        }
+    }
+
+    return best;
+}
+
+void
+TransformJobQueue::dispatch()
+{
+    m_dispatchScheduled = false;
+
+    int limit = getConcurrencyLimit();
+    int priority = 0;
+
+    while (int(m_running.size()) < limit) {
+        int next = findNext(false, priority);
+        if (next < 0) break;
+        start(next, priority, m_running);
+    }
+
+    if (!isIdle()) {
+        return;
+    }
+
+    limit = getSpeculativeLimit();
+    
+    while (int(m_speculativeRunning.size()) < limit) {
+        int next = findNext(true, priority);
+        if (next < 0) break;
+        start(next, priority, m_speculativeRunning);
+    }
+}
+
+void
+TransformJobQueue::start(int index, int priority,
+                         std::set<QObject *> &running)
+{
+    Job job = m_pending[index];
+    m_pending.erase(m_pending.begin() + index);
+
+    if (!job.pane) return;
+
+    SVDEBUG << "TransformJobQueue::dispatch: starting "
+            << (job.speculative ? "speculative " : "") << "\""
+            << job.name << "\" for pane " << job.pane << " at priority "
+            << priority << " (" << m_running.size() << " running, "
+            << m_speculativeRunning.size() << " speculative, "
+            << m_pending.size() << " pending)" << endl;
+
+    Layer *layer = job.starter();
+    if (!layer || layer->getCompletion(job.pane) >= 100) {
+        return;
+    }
+
+    running.insert(layer);
+    connect(layer, SIGNAL(modelCompletionChanged(ModelId)),
+            this, SLOT(layerCompletionChanged(ModelId)));
+    connect(layer, SIGNAL(destroyed(QObject *)),
+            this, SLOT(layerDestroyed(QObject *)));
+}
+
+void
+TransformJobQueue::layerCompletionChanged(ModelId)
+{
+    Layer *layer = qobject_cast<Layer *>(sender());
+    if (layer && layer->getCompletion(0) >= 100) {
+        finishLayer(layer);
+    }
+}
+
+void
+TransformJobQueue::layerDestroyed(QObject *layer)
+{
+    finishLayer(layer);
+}
+
+void
+TransformJobQueue::finishLayer(QObject *layer)
+{
+    bool ordinary = false;
+    
+    if (m_running.find(layer) != m_running.end()) {
+        m_running.erase(layer);
+        ordinary = true;
+    } else if (m_speculativeRunning.find(layer) !=
+               m_speculativeRunning.end()) {
+        m_speculativeRunning.erase(layer);
+    } else {
+        return;
+    }
+    
+    disconnect(layer, nullptr, this, nullptr);
+    scheduleDispatch();
+
+    if (ordinary && isIdle()) {
+        emit idle();
+    }
+}
@@ -0,0 +1,163 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Lineup
+    Comparative visualisation and alignment of related audio recordings
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef VECT_TRANSFORM_JOB_QUEUE_H
+#define VECT_TRANSFORM_JOB_QUEUE_H
+
+#include <QObject>
+#include <QString>
+#include <QPointer>
+
+#include "data/model/Model.h"
+
+#include <functional>
+#include <vector>
+#include <set>
+
+class Pane;
+class Layer;
+
+/**
+ * Queue of derived layers waiting to be created for panes, of which
+ * only a limited number are allowed to be calculating at once.
+ *
+ * Each job is a function that creates a derived layer (starting its
+ * transform) and returns it. A job counts as running until its layer
+ * reports completion or is deleted. Whenever a slot becomes free the
+ * pending job whose pane has the lowest priority value is started,
+ * with ties going to the earliest queued. Priorities are obtained
+ * afresh at that point, so changes to the current pane or scroll
+ * position take effect as soon as there is room for another job.
+ *
+ * Jobs may also be queued speculatively, for layers the user has not
+ * asked for yet but may soon. These use the cores only when nothing
+ * else is: they are started only while no ordinary job is pending or
+ * running, and then only up to a lower limit. Queueing an ordinary
+ * job drops any pending speculative ones, and emits
+ * speculationInterrupted if any are running so that their owner can
+ * cancel them.
+ */
+class TransformJobQueue : public QObject
+{
+    Q_OBJECT
+
+public:
+    typedef std::function<Layer *()> Starter;
+    typedef std::function<int(Pane *)> Prioritiser;
+
+    TransformJobQueue(Prioritiser prioritiser, QObject *parent = 0);
+    virtual ~TransformJobQueue();
+
+    /**
+     * Queue a job to create a layer with the given name for the
+     * given pane. The starter may return nullptr if the layer is no
+     * longer wanted by the time it is called.
+     */
+    void add(Pane *pane, QString name, Starter starter);
+
+    /**
+     * Queue a speculative job to create a layer with the given name
+     * for the given pane.
+     */
+    void addSpeculative(Pane *pane, QString name, Starter starter);
+
+    /**
+     * Return true if a job for a layer of the given name is pending
+     * for the given pane.
+     */
+    bool isPending(Pane *pane, QString name) const;
+
+    /**
+     * Return true if no ordinary job is pending or running.
+     */
+    bool isIdle() const;
+
+    /**
+     * Drop all pending jobs. Jobs already running are unaffected.
+     */
+    void clear();
+
+    /**
+     * Drop all pending jobs other than those for layers of the given
+     * name.
+     */
+    void clearExcept(QString name);
+
+    /**
+     * Drop all pending speculative jobs.
+     */
+    void clearSpeculative();
+
+    /**
+     * Count a layer started by a speculative job as an ordinary one
+     * from now on, because the user has asked for it after all.
+     */
+    void promote(Layer *layer);
+
+    /**
+     * Return the maximum number of jobs to run at once, which is the
+     * number of available cores.
+     */
+    static int getConcurrencyLimit();
+
+    /**
+     * Return the maximum number of speculative jobs to run at once,
+     * which is a quarter of the available cores.
+     */
+    static int getSpeculativeLimit();
+
+signals:
+    /**
+     * Emitted when the last running ordinary job finishes and none
+     * is pending.
+     */
+    void idle();
+
+    /**
+     * Emitted when an ordinary job is queued while speculative jobs
+     * are running.
+     */
+    void speculationInterrupted();
+
+public slots:
+    void dispatch();
+
+protected slots:
+    void layerCompletionChanged(ModelId);
+    void layerDestroyed(QObject *);
+
+protected:
+    struct Job {
+        QPointer<Pane> pane;
+        QString name;
+        Starter starter;
+        int sequence;
+        bool speculative;
+    };
+
+    void enqueue(Pane *pane, QString name, Starter starter, bool speculative);
+    void scheduleDispatch();
+    int findNext(bool speculative, int &priority);
+    void start(int index, int priority, std::set<QObject *> &running);
+    void finishLayer(QObject *layer);
+
+    Prioritiser m_prioritiser;
+    std::vector<Job> m_pending;
+    std::set<QObject *> m_running;
+    std::set<QObject *> m_speculativeRunning;
+    int m_sequence;
+    bool m_dispatchScheduled;
+};
+
+#endif
@@ -13,6 +13,9 @@
 */
 
 #include "MainWindow.h"
+#include "BatchAligner.h"
+#include "BackgroundPluginScan.h"
+#include "StartupTrace.h"
 
 #include "system/System.h"
 #include "system/Init.h"
@@ -21,7 +24,6 @@
 #include "base/Preferences.h"
 #include "data/fileio/PlaylistFileReader.h"
 #include "widgets/TipDialog.h"
-#include "svcore/plugin/PluginScan.h"
 
 #include <QMetaType>
 #include <QApplication>
@@ -33,6 +35,7 @@
 #include <QIcon>
 #include <QSessionManager>
 #include <QDir>
+#include <QTimer>
 
 #include <iostream>
 #include <signal.h>
@@ -160,6 +163,96 @@ setupMyVampPath()
     putEnvQStr(env);
 }
 
+static QStringList
+getFileArguments(const QStringList &args)
+{
+    QStringList filePaths;
+    
+    for (auto i = args.begin(); i != args.end(); ++i) {
+
+        if (i == args.begin()) continue;
+        if (i->startsWith('-')) continue;
+
+        QString arg = *i;
+
+        // If an arg is a playlist file, we can streamline things and
+        // make sure we get the proper absolute paths by expanding it
+        // here, rather than adding it to the session and waiting for
+        // it to be expanded in the main application logic. (That
+        // would work too, it's just not so clean a user experience.)
+
+        if (PlaylistFileReader::isSupported(arg)) {
+            PlaylistFileReader reader(arg);
+            if (!reader.isOK()) {
+                // But if we can't open the playlist file, add it to
+                // the session as if it were just any old file and let
+                // the main application worry about it later - we
+                // don't want to be popping up dialogs before the app
+                // has been exec'd
+                filePaths.push_back(arg);
+            } else {
+                auto playlist = reader.load();
+                for (auto entry: playlist) {
+                    filePaths.push_back(entry);
+                }
+            }
+        } else {
+            filePaths.push_back(arg);
+        }
+    }
+
+    for (auto &filePath: filePaths) {
+
+        // We want to avoid relative file paths, but to do so we must
+        // first check that they are not absolute URLs.
+        
+        QUrl url(filePath);
+        if (url.isRelative()) {
+            filePath = QFileInfo(filePath).absoluteFilePath();
+        }
+    }
+
+    return filePaths;
+}
+
+static int
+runBatch(VectApplication &application, const QStringList &args)
+{
+    QStringList filePaths = getFileArguments(args);
+
+    if (filePaths.size() < 2) {
+        SVCERR << "ERROR: Batch mode requires a reference file and at least one other file to align" << endl;
+        return 2;
+    }
+
+    QString outputDirectory = QDir::currentPath();
+    for (auto arg: args) {
+        if (arg.startsWith("--batch-output=")) {
+            outputDirectory = arg.section('=', 1);
+        }
+    }
+
+    QString referencePath = filePaths[0];
+    std::vector<QString> paths(filePaths.begin() + 1, filePaths.end());
+
+    BackgroundPluginScan::wait();
+
+    BatchAligner aligner(referencePath, paths, outputDirectory);
+
+    QObject::connect(&aligner, &BatchAligner::finished,
+                     [](int exitCode) { QApplication::exit(exitCode); });
+
+    QTimer::singleShot(0, &aligner, SLOT(start()));
+
+    int rv = application.exec();
+
+    cleanupMutex.lock();
+    TempDirectory::getInstance()->cleanup();
+    cleanupMutex.unlock();
+
+    return rv;
+}
+
 int
 main(int argc, char **argv)
 {
@@ -171,6 +264,33 @@ main(int argc, char **argv)
 
     svSystemSpecificInitialisation();
 
+    bool batch = false;
+    QString tracePath = getEnvQStr("SONIC_LINEUP_TRACE");
+    for (int i = 1; i < argc; ++i) {
+        QString arg(argv[i]);
+        if (arg == "--batch") {
+            batch = true;
+        } else if (arg == "--trace-startup") {
+            tracePath = "sonic-lineup-startup-trace.json";
+        } else if (arg.startsWith("--trace-startup=")) {
+            tracePath = arg.section('=', 1);
+        }
+    }
+
+    // Start the clock before anything else significant happens, so
+    // that the trace covers application construction as well
+    if (tracePath != "") {
+        StartupTrace::enable(tracePath);
+    }
+
+    StartupTrace::Span appSpan("construct application");
+
+    // Batch mode creates no windows, and must be able to run without
+    // a display server
+    if (batch && getEnvQStr("QT_QPA_PLATFORM") == "") {
+        putEnvQStr("QT_QPA_PLATFORM=offscreen");
+    }
+
     VectApplication application(argc, argv);
 
     QApplication::setOrganizationName("sonic-visualiser");
@@ -179,6 +299,12 @@ main(int argc, char **argv)
 
     setupMyVampPath();
 
+    appSpan.end();
+
+    if (StartupTrace::isEnabled()) {
+        SVCERR << "Writing startup trace to " << tracePath << endl;
+    }
+
     QStringList args = application.arguments();
 
     signal(SIGINT,  signalHandler);
@@ -195,7 +321,7 @@ main(int argc, char **argv)
 
     if (args.contains("--help") || args.contains("-h") || args.contains("-?")) {
         std::cerr << QApplication::tr(
-            "\nSonic Lineup is a comparative viewer for sets of related audio recordings.\n\nUsage:\n\n  %1 [--no-audio] [<file1>, <file2>...]\n\n  --no-audio: Do not attempt to open an audio output device\n  <file1>, <file2>...: Audio files; Sonic Lineup is designed for comparative\nviewing of multiple recordings of the same music or other related material.\n").arg(argv[0]).toStdString() << std::endl;
+            "\nSonic Lineup is a comparative viewer for sets of related audio recordings.\n\nUsage:\n\n  %1 [--no-audio] [<file1>, <file2>...]\n  %1 --batch [--batch-output=<dir>] <reference> <file2>...\n\n  --no-audio: Do not attempt to open an audio output device\n  <file1>, <file2>...: Audio files; Sonic Lineup is designed for comparative\nviewing of multiple recordings of the same music or other related material.\n  --batch: Align each file against the reference without opening a window,\nwriting each alignment path and a timings.csv file to the output directory\n(default is the current directory) using the configured alignment method.\n  --trace-startup[=<file>]: Record the time taken by each stage of startup and\nwrite it in Chrome trace format to the given file (default is\nsonic-lineup-startup-trace.json). Setting SONIC_LINEUP_TRACE to a file path\nhas the same effect.\n").arg(argv[0]).toStdString() << std::endl;
         exit(2);
     }
 
@@ -212,10 +338,14 @@ main(int argc, char **argv)
 
     QSettings settings;
     settings.beginGroup("Preferences");
-    // Running plugins in-process allows us to use the serialise
-    // option in the MATCH plugin, which cuts down on memory pressure
-    // and makes things go more smoothly
-    settings.setValue("run-vamp-plugins-in-process", true);
+    // In the interactive application, alignments are started by the
+    // document as files arrive. Running plugins in-process there
+    // allows us to use the serialise option in the MATCH plugin,
+    // which cuts down on memory pressure and makes things go more
+    // smoothly. Batch mode admits alignments itself through the
+    // AlignmentScheduler, which sizes them against available memory,
+    // so it runs them out of process where they can go in parallel
+    settings.setValue("run-vamp-plugins-in-process", !batch);
     settings.endGroup();
 
     QApplication::setAttribute(Qt::AA_UseHighDpiPixmaps);
@@ -228,6 +358,8 @@ main(int argc, char **argv)
     }
     QApplication::setWindowIcon(icon);
 
+    StartupTrace::Span translationSpan("load translations");
+
     QString language = QLocale::system().name();
 
     QTranslator qtTranslator;
@@ -255,14 +387,25 @@ main(int argc, char **argv)
         SVCERR << "Failed to load translation" << endl;
     }
 
+    translationSpan.end();
+
     StoreStartupLocale();
 
-    // Make known-plugins query as early as possible
-    PluginScan::getInstance()->scan();
+    // Make known-plugins query as early as possible. If the plugin
+    // libraries are the same as last time, this runs in the
+    // background while the main window is constructed
+    {
+        StartupTrace::Span span("start plugin scan");
+        BackgroundPluginScan::start();
+    }
     
     // Permit size_t and PropertyName to be used as args in queued signal calls
     qRegisterMetaType<PropertyContainer::PropertyName>("PropertyContainer::PropertyName");
 
+    if (batch) {
+        return runBatch(application, args);
+    }
+
     MainWindow::AudioMode audioMode = 
         MainWindow::AUDIO_PLAYBACK_NOW_RECORD_LATER;
 
@@ -270,7 +413,11 @@ main(int argc, char **argv)
         audioMode = MainWindow::AUDIO_NONE;
     } 
     
-    MainWindow *gui = new MainWindow(audioMode);
+    MainWindow *gui = nullptr;
+    {
+        StartupTrace::Span span("construct main window");
+        gui = new MainWindow(audioMode);
+    }
     application.setMainWindow(gui);
 
     QScreen *screen = QApplication::primaryScreen();
@@ -299,63 +446,32 @@ main(int argc, char **argv)
 
     settings.endGroup();
     
-    gui->show();
-
-    SmallSession session;
-    bool haveSession = false;
+    StartupTrace::watchFirstPaint(gui);
 
-    QStringList filePaths;
-    
-    for (QStringList::iterator i = args.begin(); i != args.end(); ++i) {
+    {
+        StartupTrace::Span span("show main window");
+        gui->show();
+    }
 
-        if (i == args.begin()) continue;
-        if (i->startsWith('-')) continue;
+    // Opening a session will need the plugins
+    {
+        StartupTrace::Span span("wait for plugin scan");
+        BackgroundPluginScan::wait();
+    }
 
-        QString arg = *i;
+    StartupTrace::Span sessionSpan("open initial session");
 
-        // If an arg is a playlist file, we can streamline things and
-        // make sure we get the proper absolute paths by expanding it
-        // here, rather than adding it to the session and waiting for
-        // it to be expanded in the main application logic. (That
-        // would work too, it's just not so clean a user experience.)
+    SmallSession session;
+    bool haveSession = false;
 
-        if (PlaylistFileReader::isSupported(arg)) {
-            PlaylistFileReader reader(arg);
-            if (!reader.isOK()) {
-                // But if we can't open the playlist file, add it to
-                // the session as if it were just any old file and let
-                // the main application worry about it later - we
-                // don't want to be popping up dialogs before the app
-                // has been exec'd
-                filePaths.push_back(arg);
-            } else {
-                auto playlist = reader.load();
-                for (auto entry: playlist) {
-                    filePaths.push_back(entry);
-                }
-            }
-        } else {
-            filePaths.push_back(arg);
-        }
-    }
+    QStringList filePaths = getFileArguments(args);
 
     for (auto filePath: filePaths) {
-
-        // Add the argument to our session as a file path or URL to be
-        // opened. We want to avoid relative file paths, but to do so
-        // we must first check that they are not absolute URLs.
-        
-        QUrl url(filePath);
-        if (url.isRelative()) {
-            filePath = QFileInfo(filePath).absoluteFilePath();
-        }
-        
         if (session.mainFile == "") {
             session.mainFile = filePath;
         } else {
             session.additionalFiles.push_back(filePath);
         }
-
         haveSession = true;
     }
 
@@ -370,8 +486,17 @@ main(int argc, char **argv)
         gui->checkForNewerVersion();
     }
 
+    sessionSpan.end();
+
+    QTimer::singleShot(0, [] {
+        StartupTrace::instant("event loop running");
+        StartupTrace::write();
+    });
+
     int rv = application.exec();
 
+    StartupTrace::write();
+
     cleanupMutex.lock();
     TempDirectory::getInstance()->cleanup();
     application.releaseMainWindow();
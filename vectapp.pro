@@ -69,19 +69,43 @@ for (file, SVGUI_HEADERS)    { HEADERS += $$sprintf("svgui/%1",    $$file) }
 for (file, SVAPP_HEADERS)    { HEADERS += $$sprintf("svapp/%1",    $$file) }
 
 HEADERS += \
+        main/AlignmentCache.h \
+        main/AlignmentMapping.h \
+        main/AlignmentScheduler.h \
+        main/AudioCache.h \
+        main/BackgroundPluginScan.h \
+        main/BatchAligner.h \
+        main/FeatureCache.h \
         main/IntroDialog.h \
+        main/LayerMemoryGovernor.h \
         main/MainWindow.h \
         main/NetworkPermissionTester.h \
         main/PreferencesDialog.h \
-        main/SmallSession.h
+        main/SessionCheckpointer.h \
+        main/SessionLoader.h \
+        main/SmallSession.h \
+        main/StartupTrace.h \
+        main/TransformJobQueue.h
 
 SOURCES +=  \
+        main/AlignmentCache.cpp \
+        main/AlignmentMapping.cpp \
+        main/AlignmentScheduler.cpp \
+        main/AudioCache.cpp \
+        main/BackgroundPluginScan.cpp \
+        main/BatchAligner.cpp \
+        main/FeatureCache.cpp \
         main/IntroDialog.cpp \
+        main/LayerMemoryGovernor.cpp \
 	main/main.cpp \
         main/MainWindow.cpp \
         main/NetworkPermissionTester.cpp \
         main/PreferencesDialog.cpp \
-        main/SmallSession.cpp
+        main/SessionCheckpointer.cpp \
+        main/SessionLoader.cpp \
+        main/SmallSession.cpp \
+        main/StartupTrace.cpp \
+        main/TransformJobQueue.cpp
 
 win32-msvc* {
     LIBS += -los